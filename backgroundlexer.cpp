@@ -0,0 +1,75 @@
+#include "backgroundlexer.h"
+
+namespace {
+
+// Lines per batch handed to the GUI thread.
+constexpr int kBatchLines = 2000;
+
+int lexLine(const Grammar* grammar, QStringView line, int state, LexedLines& out)
+{
+    state = grammar->tokenize(line, state, out.tokens);
+    out.tokenEnds.append(int(out.tokens.size()));
+    out.states.append(state);
+    return state;
+}
+
+}
+
+BackgroundLexer::BackgroundLexer(const Grammar* grammar, const TextSnapshot& text,
+                                 int priorityFirst, int priorityLast, int priorityState,
+                                 QObject* parent)
+    : QObject(parent), grammar_(grammar), text_(text), priorityFirst_(priorityFirst),
+    priorityLast_(priorityLast), priorityState_(priorityState)
+{}
+
+void BackgroundLexer::run()
+{
+    const int count = text_.lineCount();
+    const int first = qBound(0, priorityFirst_, count);
+    const int last = qBound(first, priorityLast_, count);
+
+    LexedLines batch;
+    batch.firstLine = first;
+    batch.firstState = priorityState_;
+    int state = priorityState_;
+    for (int line = first; line < last && !isCancelled(); ++line)
+        state = lexLine(grammar_, text_.line(line), state, batch);
+    const int priorityEnd = state;
+
+    auto flush = [&](int nextFirst, int nextState) {
+        if (batch.lineCount() > 0)
+            emit linesReady(batch);
+        batch = LexedLines();
+        batch.firstLine = nextFirst;
+        batch.firstState = nextState;
+    };
+    flush(0, Grammar::kInitialState);
+
+    state = Grammar::kInitialState;
+    bool skipping = false;
+    text_.forEachLine([&](int line, QStringView text) {
+        if (isCancelled())
+            return false;
+
+        // The guess was right: the priority lines are already correct.
+        if (line == first && last > first && state == priorityState_) {
+            flush(last, priorityEnd);
+            skipping = true;
+        }
+        if (skipping) {
+            if (line + 1 == last) {
+                skipping = false;
+                state = priorityEnd;
+            }
+            return true;
+        }
+
+        state = lexLine(grammar_, text, state, batch);
+        if (batch.lineCount() >= kBatchLines)
+            flush(line + 1, state);
+        return true;
+    });
+    flush(count, state);
+
+    emit finished();
+}
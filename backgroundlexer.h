@@ -0,0 +1,48 @@
+#pragma once
+#include <QObject>
+#include <QAtomicInt>
+#include <QVector>
+#include "grammar.h"
+#include "textbuffer.h"
+
+// Tokens and end states of a run of consecutive lines.
+struct LexedLines {
+    int firstLine = 0;
+    int firstState = 0;       // state at the start of firstLine
+    QVector<int> states;      // state at the end of each line
+    QVector<int> tokenEnds;   // the tokens of line i end at tokenEnds[i]
+    QVector<Token> tokens;
+
+    int lineCount() const { return int(states.size()); }
+};
+
+// Lexes a snapshot of a document on a worker thread. The priority lines
+// (what is on screen, plus a margin) go first, lexed from a guessed
+// starting state; then the whole text from the top, in batches. When the
+// sequential pass reaches the priority lines with the state that was
+// guessed, they are skipped rather than sent twice. Move to a QThread and
+// invoke run() from its started().
+class BackgroundLexer : public QObject {
+    Q_OBJECT
+public:
+    BackgroundLexer(const Grammar* grammar, const TextSnapshot& text, int priorityFirst,
+                    int priorityLast, int priorityState, QObject* parent = nullptr);
+
+    void cancel() { cancelled_.storeRelaxed(1); }
+    bool isCancelled() const { return cancelled_.loadRelaxed() != 0; }
+
+public slots:
+    void run();
+
+signals:
+    void linesReady(const LexedLines& lines);
+    void finished();
+
+private:
+    const Grammar* grammar_;
+    TextSnapshot text_;
+    int priorityFirst_;
+    int priorityLast_;
+    int priorityState_;
+    QAtomicInt cancelled_;
+};
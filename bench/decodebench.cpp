@@ -0,0 +1,95 @@
+// Decode throughput: TextDecoder vs the Qt paths the viewer used before.
+// Usage: DecodeBench [megabytes]
+#include "textdecoder.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <cstdio>
+#include <functional>
+
+namespace {
+
+QByteArray makeCorpus(qsizetype size, bool withUnicode)
+{
+    const QByteArray ascii =
+        "    for (int i = 0; i < count; ++i) { total += values[i] * 2; } // sum\n";
+    const QByteArray mixed =
+        "    label->setText(\"Gr\xC3\xBC\xC3\x9F" "e \xE2\x80\x93 na\xC3\xAF" "ve caf\xC3\xA9 "
+        "\xE2\x9C\x93 \xF0\x9F\x98\x80\"); // \xC3\xBC" "n\xC3\xAF" "c\xC3\xB6" "d\xC3\xA9\n";
+
+    QByteArray out;
+    out.reserve(size + ascii.size());
+    for (int line = 0; out.size() < size; ++line)
+        out += (withUnicode && line % 8 == 0) ? mixed : ascii;
+    out.truncate(size);
+
+    // Keep the buffer ending on a whole character.
+    while (!out.isEmpty() && (uchar(out.back()) & 0xC0) == 0x80)
+        out.chop(1);
+    if (!out.isEmpty() && uchar(out.back()) >= 0xC0)
+        out.chop(1);
+    return out;
+}
+
+void run(const char* name, const QByteArray& input, const std::function<qsizetype()>& fn)
+{
+    constexpr int kRounds = 5;
+    qint64 best = -1;
+    qsizetype units = 0;
+
+    for (int r = 0; r < kRounds; ++r) {
+        QElapsedTimer timer;
+        timer.start();
+        units = fn();
+        const qint64 ns = timer.nsecsElapsed();
+        if (best < 0 || ns < best)
+            best = ns;
+    }
+
+    const double gbps = double(input.size()) / double(best);
+    std::printf("  %-22s %8.3f GB/s  (%lld units)\n", name, gbps, static_cast<long long>(units));
+}
+
+void benchCorpus(const char* label, const QByteArray& input)
+{
+    std::printf("%s, %.1f MB:\n", label, input.size() / (1024.0 * 1024.0));
+
+    run("QTextStream::readAll", input, [&]() {
+        QByteArray copy = input;
+        QBuffer buffer(&copy);
+        buffer.open(QIODevice::ReadOnly | QIODevice::Text);
+        QTextStream in(&buffer);
+        return in.readAll().size();
+    });
+
+    run("QString::fromUtf8", input, [&]() {
+        return QString::fromUtf8(input).size();
+    });
+
+    run("TextDecoder::decode", input, [&]() {
+        return TextDecoder::decode(input).size();
+    });
+
+    run("TextDecoder::feed (1MB)", input, [&]() {
+        TextDecoder decoder;
+        qsizetype total = 0;
+        for (qsizetype pos = 0; pos < input.size(); pos += 1024 * 1024)
+            total += decoder.feed(input.constData() + pos,
+                                  qMin<qsizetype>(1024 * 1024, input.size() - pos)).size();
+        return total;
+    });
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const qsizetype megabytes = argc > 1 ? QByteArray(argv[1]).toLongLong() : 256;
+    const qsizetype size = qMax<qsizetype>(1, megabytes) * 1024 * 1024;
+
+    std::printf("vector path: %s\n", TextDecoder::simdLevel());
+    benchCorpus("ASCII source", makeCorpus(size, false));
+    benchCorpus("UTF-8 source (1/8 lines non-ASCII)", makeCorpus(size, true));
+    return 0;
+}
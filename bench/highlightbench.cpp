@@ -0,0 +1,366 @@
+// Highlighting throughput over generated C++ corpora: the lexer alone
+// against the regex rules it replaced, codehighlighter::highlightBlock (a full rehighlight, then one from the
+// block cache), highlightLine and setDarkMode. Reports lines/s, bytes/s
+// and heap allocations per line, and the longest the event loop waits
+// while a document is coloured within the time budget. Writes the results
+// as JSON.
+// Usage: FileExplorerBench [max lines] [output.json]
+#include "codehighlighter.h"
+#include "grammar.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTextDocument>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <new>
+
+// Every allocation in the process goes through here and is counted.
+static std::atomic<quint64> allocations{ 0 };
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+// Documents bigger than this (in characters) are only lexed; a
+// QTextDocument of them takes more memory than the numbers are worth.
+constexpr qsizetype kMaxDocumentChars = 64 * 1024 * 1024;
+
+enum class Shape { Short, Long, Comments, Strings };
+
+const char* shapeName(Shape shape)
+{
+    switch (shape) {
+    case Shape::Short: return "short";
+    case Shape::Long: return "long";
+    case Shape::Comments: return "comments";
+    case Shape::Strings: return "strings";
+    }
+    return "";
+}
+
+// Lines cycle through a few templates per shape, so every corpus mixes
+// keywords, names, numbers, calls and literals.
+QString makeCorpus(Shape shape, int lines)
+{
+    static const char* const code[] = {
+        "    for (int i = 0; i < count; ++i) { total += values[i] * 2; }",
+        "    const QString name = item->text(column);",
+        "    if (!widget || widget->isHidden()) return nullptr;",
+        "#include <vector>",
+        "static constexpr qint64 kLimit = 0x7fff'ffffLL;",
+        "void Parser::parse(const QByteArray& input, int flags) {",
+        "    return std::max(left, right) + offset;",
+        "}",
+    };
+    static const char* const comments[] = {
+        "// Walks the tree and returns the first node that matches.",
+        "/* Block comments run over",
+        "   several lines, like this one,",
+        "   and end here. */",
+        "    int depth = 0;   // how far down we are",
+        "/// Documentation comment for the next declaration.",
+    };
+    static const char* const strings[] = {
+        "    label->setText(\"Saved \\\"\" + name + \"\\\" to disk\");",
+        "    const char* path = \"C:\\\\Users\\\\data\\\\file.txt\";",
+        "    auto raw = R\"json({\"key\": [1, 2, 3]})json\";",
+        "    QStringList names = { \"alpha\", \"beta\", \"gamma\", u8\"delta\" };",
+        "    char quote = '\\'';",
+    };
+
+    QString out;
+    for (int line = 0; line < lines; ++line) {
+        switch (shape) {
+        case Shape::Short:
+            out += QLatin1String(code[line % std::size(code)]);
+            break;
+        case Shape::Long:
+            // About 350 characters: several statements on one line.
+            for (int k = 0; k < 7; ++k)
+                out += QLatin1String(code[(line + k) % std::size(code)]);
+            break;
+        case Shape::Comments:
+            out += QLatin1String(line % 4 == 3 ? code[line % std::size(code)]
+                                               : comments[line % std::size(comments)]);
+            break;
+        case Shape::Strings:
+            out += QLatin1String(line % 4 == 3 ? code[line % std::size(code)]
+                                               : strings[line % std::size(strings)]);
+            break;
+        }
+        out += QLatin1Char('\n');
+    }
+    out.chop(1);
+    return out;
+}
+
+// The regex rules codehighlighter ran before the lexer, matched the way
+// its highlightBlock did: every rule over the whole line, then the block
+// comment scan. Matches are recorded as tokens where it called setFormat,
+// so both sides of the comparison only produce ranges.
+class RegexBaseline {
+public:
+    RegexBaseline()
+    {
+        for (const char* word : { "class", "const", "int", "float", "return", "if", "else" })
+            add(QStringLiteral("\\b%1\\b").arg(QLatin1String(word)), TokenClass::Keyword);
+        add(QStringLiteral("//[^\n]*"), TokenClass::Comment);
+        add(QStringLiteral("\".*\""), TokenClass::String);
+        add(QStringLiteral("\\b(?:int|float|double|QString)\\s+(\\w+)\\b"), TokenClass::Variable);
+        add(QStringLiteral("\\b\\w+(?=\\()"), TokenClass::Method);
+        add(QStringLiteral("\\b[A-Z][A-Za-z0-9_]*\\b"), TokenClass::Class);
+        add(QStringLiteral("\\b\\d+\\b"), TokenClass::Number);
+        add(QStringLiteral("\\b\\d+\\.\\d+\\b"), TokenClass::Number);
+        add(QStringLiteral("0x[0-9A-Fa-f]+"), TokenClass::Number);
+        add(QStringLiteral("^\\s*#\\w+"), TokenClass::Preprocessor);
+        add(QStringLiteral("\\(([^)]*)\\)"), TokenClass::Parameter);
+    }
+
+    // Returns the block state: 1 inside a block comment.
+    int highlight(const QString& text, int previousState, QVector<Token>& tokens) const
+    {
+        for (const Rule& rule : rules_) {
+            auto it = rule.pattern.globalMatch(text);
+            while (it.hasNext()) {
+                const QRegularExpressionMatch match = it.next();
+                // The parameter rule was told apart by comparing pattern
+                // strings, once per match.
+                const int group = rule.pattern.pattern() == QLatin1String("\\(([^)]*)\\)") ? 1 : 0;
+                tokens.append({ int(match.capturedStart(group)), int(match.capturedLength(group)), rule.cls });
+            }
+        }
+
+        int state = 0;
+        qsizetype start = previousState == 1 ? 0 : text.indexOf(commentStart_);
+        while (start >= 0) {
+            const QRegularExpressionMatch end = commentEnd_.match(text, start);
+            qsizetype length;
+            if (!end.hasMatch()) {
+                state = 1;
+                length = text.size() - start;
+            } else {
+                length = end.capturedStart() - start + end.capturedLength();
+            }
+            tokens.append({ int(start), int(length), TokenClass::Comment });
+            start = text.indexOf(commentStart_, start + length);
+        }
+        return state;
+    }
+
+private:
+    struct Rule {
+        QRegularExpression pattern;
+        TokenClass cls;
+    };
+
+    void add(const QString& pattern, TokenClass cls) { rules_.append({ QRegularExpression(pattern), cls }); }
+
+    QVector<Rule> rules_;
+    QRegularExpression commentStart_{ QStringLiteral("/\\*") };
+    QRegularExpression commentEnd_{ QStringLiteral("\\*/") };
+};
+
+struct Corpus {
+    Shape shape;
+    int lines;
+    QString text;
+    QStringList lineList;
+    qint64 bytes;   // UTF-8, as on disk
+};
+
+QJsonArray results;
+
+// Times fn once (it is long enough at every size worth reading) and
+// reports per-line and per-byte rates. Returns lines per second.
+double measure(const Corpus& corpus, const char* name, const std::function<void()>& fn)
+{
+    const quint64 allocationsBefore = allocations.load();
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    const qint64 ns = qMax<qint64>(1, timer.nsecsElapsed());
+    const quint64 allocated = allocations.load() - allocationsBefore;
+
+    const double seconds = ns / 1e9;
+    const double linesPerSecond = corpus.lines / seconds;
+    const double bytesPerSecond = corpus.bytes / seconds;
+    const double allocationsPerLine = double(allocated) / corpus.lines;
+    std::printf("  %-9s %8d lines  %-22s %12.0f lines/s %9.1f MB/s %8.2f allocs/line\n",
+                shapeName(corpus.shape), corpus.lines, name, linesPerSecond,
+                bytesPerSecond / (1024.0 * 1024.0), allocationsPerLine);
+
+    results.append(QJsonObject{
+        { "corpus", QLatin1String(shapeName(corpus.shape)) },
+        { "lines", corpus.lines },
+        { "bytes", corpus.bytes },
+        { "measure", QLatin1String(name) },
+        { "seconds", seconds },
+        { "linesPerSecond", linesPerSecond },
+        { "bytesPerSecond", bytesPerSecond },
+        { "allocationsPerLine", allocationsPerLine },
+    });
+    return linesPerSecond;
+}
+
+// Colours a fresh document the way the viewer does, with the default
+// time budget, and reports the longest time between two returns to the
+// event loop: the worst input latency while it runs.
+void measureLatency(const Corpus& corpus)
+{
+    const int budget = codehighlighter::timeBudget();
+    codehighlighter::setTimeBudget(codehighlighter::kDefaultTimeBudgetMs);
+    {
+        QTextDocument document;
+        document.setPlainText(corpus.text);
+        codehighlighter highlighter(&document, true);
+        highlighter.rehighlightInBackground();
+
+        qint64 worstNs = 0;
+        QElapsedTimer timer;
+        do {
+            timer.start();
+            QCoreApplication::processEvents();
+            worstNs = qMax(worstNs, timer.nsecsElapsed());
+        } while (highlighter.isSweeping());
+
+        const double worstMs = worstNs / 1e6;
+        std::printf("  %-9s %8d lines  %-22s %12.2f ms\n",
+                    shapeName(corpus.shape), corpus.lines, "worst event loop wait", worstMs);
+        results.append(QJsonObject{
+            { "corpus", QLatin1String(shapeName(corpus.shape)) },
+            { "lines", corpus.lines },
+            { "bytes", corpus.bytes },
+            { "measure", "worst event loop wait" },
+            { "budgetMs", codehighlighter::kDefaultTimeBudgetMs },
+            { "milliseconds", worstMs },
+        });
+    }
+    codehighlighter::setTimeBudget(budget);
+}
+
+void benchCorpus(const Corpus& corpus)
+{
+    const Grammar* grammar = Grammar::cpp();
+
+    const double lexRate = measure(corpus, "lex", [&]() {
+        QVector<Token> tokens;
+        int state = Grammar::kInitialState;
+        for (const QString& line : corpus.lineList) {
+            tokens.clear();
+            state = grammar->tokenize(line, state, tokens);
+        }
+    });
+
+    const RegexBaseline baseline;
+    const double regexRate = measure(corpus, "regex baseline", [&]() {
+        QVector<Token> tokens;
+        int state = 0;
+        for (const QString& line : corpus.lineList) {
+            tokens.clear();
+            state = baseline.highlight(line, state, tokens);
+        }
+    });
+    std::printf("  %-9s %8d lines  %-22s %12.1fx\n",
+                shapeName(corpus.shape), corpus.lines, "lex / regex baseline", lexRate / regexRate);
+    results.append(QJsonObject{
+        { "corpus", QLatin1String(shapeName(corpus.shape)) },
+        { "lines", corpus.lines },
+        { "bytes", corpus.bytes },
+        { "measure", "lex / regex baseline" },
+        { "ratio", lexRate / regexRate },
+    });
+
+    {
+        codehighlighter highlighter(nullptr, true);
+        measure(corpus, "highlightLine", [&]() {
+            for (const QString& line : corpus.lineList)
+                highlighter.highlightLine(line);
+        });
+    }
+
+    if (corpus.text.size() > kMaxDocumentChars)
+        return;
+
+    QTextDocument document;
+    document.setPlainText(corpus.text);
+    codehighlighter highlighter(&document, true);
+
+    // The first rehighlight lexes every block; the second finds their
+    // tokens cached and only sets formats.
+    measure(corpus, "highlightBlock", [&]() { highlighter.rehighlight(); });
+    QCoreApplication::processEvents();   // the highlighter's own delayed rehighlight
+    measure(corpus, "highlightBlock cached", [&]() { highlighter.rehighlight(); });
+
+    // The visible lines are restyled in the call, the rest in slices.
+    measure(corpus, "setDarkMode", [&]() {
+        highlighter.setDarkMode(false);
+        while (highlighter.isSweeping())
+            QCoreApplication::processEvents();
+    });
+
+    measureLatency(corpus);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // No window is shown; the documents only need fonts.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    // Whole passes are timed, so colouring is not cut into slices except
+    // where latency is measured.
+    codehighlighter::setTimeBudget(0);
+
+    const int maxLines = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+    const QString output = argc > 2 ? QString::fromLocal8Bit(argv[2]) : QStringLiteral("highlightbench.json");
+
+    for (int lines = 1000; lines <= qMax(1000, maxLines); lines *= 10) {
+        for (Shape shape : { Shape::Short, Shape::Long, Shape::Comments, Shape::Strings }) {
+            Corpus corpus{ shape, lines, makeCorpus(shape, lines), {}, 0 };
+            corpus.lineList = corpus.text.split(QLatin1Char('\n'));
+            corpus.bytes = corpus.text.toUtf8().size();
+            benchCorpus(corpus);
+        }
+    }
+
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::fprintf(stderr, "cannot write %s\n", qPrintable(output));
+        return 1;
+    }
+    file.write(QJsonDocument(QJsonObject{
+        { "benchmark", "highlighting" },
+        { "results", results },
+    }).toJson());
+    std::printf("results written to %s\n", qPrintable(output));
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "bytesource.h"
+
+MappedSource::~MappedSource()
+{
+    if (data_)
+        file_.unmap(const_cast<uchar*>(data_));
+}
+
+bool MappedSource::open(const QString& path)
+{
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::ReadOnly))
+        return false;
+
+    size_ = file_.size();
+    if (size_ > 0) {
+        data_ = file_.map(0, size_);
+        if (!data_) {
+            size_ = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+QByteArrayView MappedSource::bytes(qint64 offset, qint64 length)
+{
+    offset = qBound<qint64>(0, offset, size_);
+    length = qBound<qint64>(0, length, size_ - offset);
+    if (!data_)
+        return QByteArrayView();
+    return QByteArrayView(data_ + offset, length);
+}
+
+bool MappedSource::refresh()
+{
+    const qint64 newSize = file_.size();
+    if (newSize == size_)
+        return true;
+    if (newSize < size_)
+        return false;
+
+    // Map the longer range before dropping the old one.
+    const uchar* data = file_.map(0, newSize);
+    if (!data)
+        return false;
+    if (data_)
+        file_.unmap(const_cast<uchar*>(data_));
+
+    data_ = data;
+    size_ = newSize;
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+
+// Random access to the bytes shown by LargeFileView, so the same view can
+// sit on a mapped file or on a decompressed stream.
+class ByteSource {
+public:
+    virtual ~ByteSource() = default;
+
+    virtual qint64 size() const = 0;
+
+    // Contiguous bytes [offset, offset + length), clamped to size(). The
+    // view stays valid until the next call. Callers keep length to a few
+    // MB at most.
+    virtual QByteArrayView bytes(qint64 offset, qint64 length) = 0;
+
+    // Picks up a change of the underlying file. Returns false if the file
+    // can no longer be read as before (it shrank, or cannot be mapped).
+    virtual bool refresh() { return true; }
+};
+
+// The whole file mapped into memory; bytes() never copies.
+class MappedSource : public ByteSource {
+public:
+    ~MappedSource() override;
+
+    bool open(const QString& path);
+
+    qint64 size() const override { return size_; }
+    QByteArrayView bytes(qint64 offset, qint64 length) override;
+    bool refresh() override;
+
+private:
+    QFile file_;
+    const uchar* data_ = nullptr;
+    qint64 size_ = 0;
+};
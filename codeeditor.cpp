@@ -228,21 +228,26 @@ void CodeEditor::drawIndentScope(QPainter* p)
     p->setBrush(scopeColor);
     p->setPen(Qt::NoPen);
 
-    QTextBlock block = document()->findBlockByNumber(start);
-
     int firstIndentX = 0;
     {
         int tmp = 0;
-        indentLevelOf(block.text(), &tmp);
+        indentLevelOf(document()->findBlockByNumber(start).text(), &tmp);
         firstIndentX = tmp;
     }
 
     int paddingLeft  = firstIndentX - fontMetrics().horizontalAdvance(' ') * 0.5;
     int paddingRight = firstIndentX + fontMetrics().horizontalAdvance(' ') * 8; // extend a bit into text
 
+    // Only the part of the scope inside the viewport is painted.
+    QTextBlock block = firstVisibleBlock();
+    if (block.blockNumber() < start)
+        block = document()->findBlockByNumber(start);
+
     while (block.isValid() && block.blockNumber() <= end)
     {
         QRectF r = blockBoundingGeometry(block).translated(contentOffset());
+        if (r.top() > viewport()->height())
+            break;
 
         r.setLeft(qMax(0, paddingLeft));
         r.setRight(qMin(viewport()->width(), paddingRight));
@@ -399,11 +404,15 @@ void CodeEditor::drawScope(QPainter* p)
     p->setBrush(scopeColor);
     p->setPen(Qt::NoPen);
 
-    QTextBlock block = document()->findBlockByNumber(start);
+    QTextBlock block = firstVisibleBlock();
+    if (block.blockNumber() < start)
+        block = document()->findBlockByNumber(start);
 
     while (block.isValid() && block.blockNumber() <= end)
     {
         QRectF r = blockBoundingGeometry(block).translated(contentOffset());
+        if (r.top() > viewport()->height())
+            break;
         r.setLeft(0);
         r.setRight(viewport()->width());
         p->drawRect(r);
@@ -457,8 +466,10 @@ QPair<int,int> CodeEditor::ifElseChainScope() const
     int finalStart = start;
     int finalEnd   = end;
 
-    for (int i = start; i <= end; ++i) {
-        QTextBlock b = document()->findBlockByNumber(i);
+    // up stopped one block before start; walk forward instead of looking
+    // every line up by number.
+    QTextBlock b = up.isValid() ? up.next() : document()->begin();
+    for (; b.isValid() && b.blockNumber() <= end; b = b.next()) {
         QString t = b.text().trimmed();
 
         if (!isIfElseLine(t))
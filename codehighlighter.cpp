@@ -1,20 +1,37 @@
 #include "codehighlighter.h"
+#include "highlightcache.h"
 
-codehighlighter::codehighlighter(QTextDocument* parent, bool darkMode)
-    : QSyntaxHighlighter(parent) {
-    // setupRules(darkMode);
-    setDarkMode(darkMode);
-}
+#include <QElapsedTimer>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QThread>
+#include <QTimer>
 
-void codehighlighter::setDarkMode(bool enabled) {
-    highlightingRules.clear();
-    setupRules(enabled);
-    rehighlight(); // force refresh
-}
+namespace {
+// Documents up to this many lines are lexed on the GUI thread.
+constexpr int kInlineLines = 2000;
+// Quiet time after an edit before an outdated pass starts over.
+constexpr int kRestartDelayMs = 300;
+// Characters of a cached document hashed per step of its check.
+constexpr qint64 kVerifyChars = 256 * 1024;
 
-void codehighlighter::setupRules(bool darkMode) {
-    HighlightingRule rule;
+// Lines [from, to) of lines as a batch of their own.
+LexedLines sliceLines(const LexedLines& lines, int from, int to)
+{
+    LexedLines slice;
+    slice.firstLine = lines.firstLine + from;
+    slice.firstState = from > 0 ? lines.states[from - 1] : lines.firstState;
+    const int tokenBase = from > 0 ? lines.tokenEnds[from - 1] : 0;
+    slice.states = lines.states.mid(from, to - from);
+    slice.tokenEnds.reserve(to - from);
+    for (int i = from; i < to; ++i)
+        slice.tokenEnds.append(lines.tokenEnds[i] - tokenBase);
+    slice.tokens = lines.tokens.mid(tokenBase, (to > from ? lines.tokenEnds[to - 1] : tokenBase) - tokenBase);
+    return slice;
+}
 
+HighlightTheme makeTheme(bool darkMode)
+{
     // Palette
     QColor keywordColor   = darkMode ? QColor("#4FC3F7") : QColor("#1565C0");
     QColor commentColor   = darkMode ? QColor("#81C784") : QColor("#2E7D32");
@@ -26,164 +43,532 @@ void codehighlighter::setupRules(bool darkMode) {
     QColor preprocColor   = darkMode ? QColor("#FFEB3B") : QColor("#F57F17");
     QColor paramColor     = darkMode ? QColor("#FFB74D") : QColor("#EF6C00");
 
-    // Keywords
+    HighlightTheme theme;
+    auto format = [&theme](TokenClass cls) -> QTextCharFormat& { return theme.formats[int(cls)]; };
+
+    QTextCharFormat& keywordFormat = format(TokenClass::Keyword);
     keywordFormat.setForeground(keywordColor);
     keywordFormat.setFontWeight(QFont::Bold);
-    QStringList keywords = {"class","const","int","float","return","if","else"};
-    for (const QString& word : keywords) {
-        rule.pattern = QRegularExpression("\\b" + word + "\\b");
-        rule.format = keywordFormat;
-        highlightingRules.append(rule);
-    }
-
-    // Single-line comments
-    commentFormat.setForeground(commentColor);
-    rule.pattern = QRegularExpression("//[^\n]*");
-    rule.format = commentFormat;
-    highlightingRules.append(rule);
-
-    // Strings
-    stringFormat.setForeground(stringColor);
-    rule.pattern = QRegularExpression("\".*\"");
-    rule.format = stringFormat;
-    highlightingRules.append(rule);
-
-    // Variables
+
+    format(TokenClass::Comment).setForeground(commentColor);
+    format(TokenClass::String).setForeground(stringColor);
+
+    QTextCharFormat& variableFormat = format(TokenClass::Variable);
     variableFormat.setForeground(variableColor);
     variableFormat.setFontItalic(true);
-    rule.pattern = QRegularExpression("\\b(?:int|float|double|QString)\\s+(\\w+)\\b");
-    rule.format = variableFormat;
-    highlightingRules.append(rule);
 
-    // Methods
+    QTextCharFormat& methodFormat = format(TokenClass::Method);
     methodFormat.setForeground(methodColor);
     methodFormat.setFontWeight(QFont::Bold);
-    rule.pattern = QRegularExpression("\\b\\w+(?=\\()");
-    rule.format = methodFormat;
-    highlightingRules.append(rule);
 
-    // Classes
+    QTextCharFormat& classFormat = format(TokenClass::Class);
     classFormat.setForeground(classColor);
     classFormat.setFontWeight(QFont::Bold);
-    rule.pattern = QRegularExpression("\\b[A-Z][A-Za-z0-9_]*\\b");
-    rule.format = classFormat;
-    highlightingRules.append(rule);
 
-    // Numbers
+    QTextCharFormat& numberFormat = format(TokenClass::Number);
     numberFormat.setForeground(numberColor);
     numberFormat.setFontWeight(QFont::Bold);
-    rule.pattern = QRegularExpression("\\b\\d+\\b"); // integers
-    rule.format = numberFormat;
-    highlightingRules.append(rule);
-    rule.pattern = QRegularExpression("\\b\\d+\\.\\d+\\b"); // floats
-    rule.format = numberFormat;
-    highlightingRules.append(rule);
-    rule.pattern = QRegularExpression("0x[0-9A-Fa-f]+"); // hex
-    rule.format = numberFormat;
-    highlightingRules.append(rule);
-
-    // Preprocessor
+
+    QTextCharFormat& preprocessorFormat = format(TokenClass::Preprocessor);
     preprocessorFormat.setForeground(preprocColor);
     preprocessorFormat.setFontWeight(QFont::Bold);
-    rule.pattern = QRegularExpression("^\\s*#\\w+");
-    rule.format = preprocessorFormat;
-    highlightingRules.append(rule);
 
-    // Parameters
+    QTextCharFormat& parameterFormat = format(TokenClass::Parameter);
     parameterFormat.setForeground(paramColor);
     parameterFormat.setFontItalic(true);
-    rule.pattern = QRegularExpression("\\(([^)]*)\\)");
-    rule.format = parameterFormat;
-    highlightingRules.append(rule);
 
-    // Multi-line comments setup
-    commentStartExpression = QRegularExpression("/\\*");
-    commentEndExpression   = QRegularExpression("\\*/");
+    return theme;
+}
+
+}
+
+const HighlightTheme& HighlightTheme::get(bool darkMode)
+{
+    static const HighlightTheme dark = makeTheme(true);
+    static const HighlightTheme light = makeTheme(false);
+    return darkMode ? dark : light;
+}
+
+int codehighlighter::timeBudgetMs_ = codehighlighter::kDefaultTimeBudgetMs;
+
+codehighlighter::codehighlighter(QTextDocument* parent, bool darkMode)
+    : QSyntaxHighlighter(parent) {
+    applyTimer_ = new QTimer(this);
+    applyTimer_->setSingleShot(true);
+    applyTimer_->setInterval(0);
+    connect(applyTimer_, &QTimer::timeout, this, &codehighlighter::applyPending);
+
+    restartTimer_ = new QTimer(this);
+    restartTimer_->setSingleShot(true);
+    restartTimer_->setInterval(kRestartDelayMs);
+    connect(restartTimer_, &QTimer::timeout, this, &codehighlighter::rehighlightInBackground);
+
+    sweepTimer_ = new QTimer(this);
+    sweepTimer_->setSingleShot(true);
+    sweepTimer_->setInterval(0);
+    connect(sweepTimer_, &QTimer::timeout, this, &codehighlighter::sweepSlice);
+
+    // Fires once control is back in the event loop.
+    budgetTimer_ = new QTimer(this);
+    budgetTimer_->setSingleShot(true);
+    budgetTimer_->setInterval(0);
+    connect(budgetTimer_, &QTimer::timeout, this, [this]() { budgetClock_.invalidate(); });
+
+    verifyTimer_ = new QTimer(this);
+    verifyTimer_->setSingleShot(true);
+    verifyTimer_->setInterval(0);
+    connect(verifyTimer_, &QTimer::timeout, this, &codehighlighter::verifySlice);
+
+    darkMode_ = darkMode;
+    theme_ = &HighlightTheme::get(darkMode);
+}
+
+codehighlighter::~codehighlighter()
+{
+    stopBackground();
+}
+
+void codehighlighter::setTimeBudget(int ms)
+{
+    timeBudgetMs_ = qMax(0, ms);
+}
+
+void codehighlighter::startBudget()
+{
+    budgetClock_.start();
+    budgetTimer_->start();
+}
+
+bool codehighlighter::overBudget(const QElapsedTimer& clock)
+{
+    return timeBudgetMs_ > 0 && clock.hasExpired(timeBudgetMs_);
+}
+
+void codehighlighter::setDarkMode(bool enabled) {
+    if (enabled == darkMode_)
+        return;
+    darkMode_ = enabled;
+    theme_ = &HighlightTheme::get(enabled);
+
+    // Blocks keep their token classes; only the formats change. Lines on
+    // screen are done now, the rest in slices.
+    if (!document())
+        return;
+    int first = 0;
+    int last = 0;
+    priorityLines(&first, &last);
+    QTextBlock block = document()->findBlockByNumber(first);
+    for (int line = first; line < last && block.isValid(); ++line, block = block.next())
+        sweepBlock(block, false);
+    startSweep(document()->begin(), false);
+}
+
+void codehighlighter::startSweep(const QTextBlock& from, bool lex)
+{
+    // A sweep under way goes on from whichever block is earlier, and lexes
+    // if either would.
+    if (sweepCursor_.isNull() || from.position() < sweepCursor_.position())
+        sweepCursor_ = QTextCursor(from);
+    sweepLexes_ = sweepLexes_ || lex;
+    if (!sweepTimer_->isActive())
+        sweepTimer_->start();
+}
+
+void codehighlighter::sweepBlock(const QTextBlock& block, bool lex)
+{
+    // Blocks never lexed have no formats to change; they are left to
+    // whatever lexes them unless the sweep lexes.
+    const auto* data = static_cast<const BlockTokens*>(block.userData());
+    if (cachedTokens(block) ? data->theme != theme_ : lex)
+        rehighlightBlock(block);
+}
+
+bool codehighlighter::isSweeping() const
+{
+    return !sweepCursor_.isNull();
+}
+
+void codehighlighter::sweepSlice()
+{
+    if (sweepCursor_.isNull())
+        return;
+    startBudget();
+    QTextBlock block = sweepCursor_.block();
+    while (block.isValid() && !overBudget(budgetClock_)) {
+        sweepBlock(block, sweepLexes_);
+        block = block.next();
+    }
+
+    // Blocks deferred in the slice are all below the one it stopped at.
+    if (block.isValid()) {
+        sweepCursor_ = QTextCursor(block);
+        sweepTimer_->start();
+    } else {
+        sweepCursor_ = QTextCursor();
+        sweepLexes_ = false;
+    }
+}
+
+bool codehighlighter::deferBlock(const QTextBlock& block, const BlockTokens* data)
+{
+    int first = 0;
+    int last = 0;
+    priorityLines(&first, &last);
+    const int line = block.blockNumber();
+    if (line >= first && line < last)
+        return false;
+
+    // The block keeps its formats and state, so the cascade ends here.
+    if (data) {
+        for (const Token& token : qAsConst(data->tokens))
+            setFormat(token.start, token.length, theme_->format(token.cls));
+    }
+    setCurrentBlockState(currentBlockState());
+    // Lines a running pass has yet to colour are left to it.
+    if (!isHighlighting() || (line < applied_.size() && applied_.testBit(line)))
+        startSweep(block, true);
+    return true;
 }
 
 void codehighlighter::highlightBlock(const QString& text) {
-    for (const HighlightingRule& rule : qAsConst(highlightingRules)) {
-        auto matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            auto match = matchIterator.next();
-
-            if (rule.pattern.pattern() == "\\(([^)]*)\\)") {
-                int start = match.capturedStart(1);
-                int length = match.capturedLength(1);
-                setFormat(start, length, rule.format);
-            } else {
-                setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+    const QTextBlock block = currentBlock();
+    const int inState = qMax(0, previousBlockState());
+    auto* data = static_cast<BlockTokens*>(currentBlockUserData());
+    if (!budgetClock_.isValid())
+        startBudget();
+
+    if (applying_ || deferred_) {
+        const int line = block.blockNumber();
+
+        // Lines of the batch being applied, including the following ones
+        // QSyntaxHighlighter revisits when a block's state changes.
+        const int index = applying_ ? line - applying_->firstLine : -1;
+        if (index >= 0 && index < applying_->lineCount()) {
+            if (!data) {
+                data = new BlockTokens;
+                setCurrentBlockUserData(data);
             }
+            const Token* tokens = applying_->tokens.constData();
+            data->tokens = QVector<Token>(tokens + (index > 0 ? applying_->tokenEnds[index - 1] : 0),
+                                          tokens + applying_->tokenEnds[index]);
+            data->revision = block.revision();
+            data->length = block.length();
+            data->inState = index > 0 ? applying_->states[index - 1] : applying_->firstState;
+            data->outState = applying_->states[index];
+            data->theme = theme_;
+
+            for (const Token& token : qAsConst(data->tokens))
+                setFormat(token.start, token.length, theme_->format(token.cls));
+            setCurrentBlockState(data->outState);
+            if (line < applied_.size())
+                applied_.setBit(line);
+            lastApplied_ = line;
+            return;
         }
     }
 
-    // Multi-line comments
-    setCurrentBlockState(0);
-    int startIndex = 0;
-    if (previousBlockState() != 1)
-        startIndex = text.indexOf(commentStartExpression);
+    // Lexed before with the same text and incoming state: only the
+    // formats are set again (after a theme switch, say).
+    const bool cached = data && data->revision == block.revision()
+        && data->length == block.length() && data->inState == inState;
+
+    if (!cached && deferred_) {
+        // Text loaded off screen waits for the background pass.
+        int first = 0;
+        int last = 0;
+        priorityLines(&first, &last);
+        const int line = block.blockNumber();
+        if (line < first || line >= last) {
+            setCurrentBlockState(inState);
+            return;
+        }
+    }
 
-    while (startIndex >= 0) {
-        auto endMatch = commentEndExpression.match(text, startIndex);
-        int endIndex = endMatch.hasMatch() ? endMatch.capturedStart() : -1;
-        int commentLength;
+    // A state change cascading past the time budget: the rest of the way
+    // is left to the sweep.
+    if (!cached && overBudget(budgetClock_) && deferBlock(block, data))
+        return;
 
-        if (endIndex == -1) {
-            setCurrentBlockState(1);
-            commentLength = text.length() - startIndex;
-        } else {
-            commentLength = endIndex - startIndex + endMatch.capturedLength();
+    if (!cached) {
+        if (!data) {
+            data = new BlockTokens;
+            setCurrentBlockUserData(data);
         }
+        // One scan per block; the state carries open comments and strings over.
+        data->tokens.clear();
+        data->outState = grammar_->tokenize(text, inState, data->tokens);
+        data->revision = block.revision();
+        data->length = block.length();
+        data->inState = inState;
+    }
+
+    for (const Token& token : qAsConst(data->tokens))
+        setFormat(token.start, token.length, theme_->format(token.cls));
+    data->theme = theme_;
+    setCurrentBlockState(data->outState);
+}
+
+void codehighlighter::setGrammar(const Grammar* grammar)
+{
+    if (!grammar || grammar == grammar_)
+        return;
+    stopBackground();
+    grammar_ = grammar;
 
-        setFormat(startIndex, commentLength, commentFormat);
-        startIndex = text.indexOf(commentStartExpression, startIndex + commentLength);
+    // Tokens and states of the old language mean nothing to the new one.
+    if (!document())
+        return;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        block.setUserData(nullptr);
+        block.setUserState(-1);
     }
+    rehighlightInBackground();
 }
 
-QVector<MiniToken> codehighlighter::highlightLine(const QString& line) const
+const QVector<Token>* codehighlighter::cachedTokens(const QTextBlock& block)
 {
-    QVector<MiniToken> tokens;
+    const auto* data = static_cast<const BlockTokens*>(block.userData());
+    if (!data || data->revision != block.revision() || data->length != block.length()
+        || data->inState != qMax(0, block.previous().userState()))
+        return nullptr;
+    return &data->tokens;
+}
 
-    int i = 0;
-    while (i < line.length())
-    {
-        bool matched = false;
+void codehighlighter::rehighlightInBackground()
+{
+    stopBackground();
+    if (!document())
+        return;
+    if (!buffer_ || buffer_->lineCount() <= kInlineLines) {
+        // Lines on screen now, the rest in slices.
+        int first = 0;
+        int last = 0;
+        priorityLines(&first, &last);
+        QTextBlock block = document()->findBlockByNumber(first);
+        for (int line = first; line < last && block.isValid(); ++line, block = block.next())
+            sweepBlock(block, true);
+        startSweep(document()->begin(), true);
+        return;
+    }
 
-        for (const HighlightingRule& rule : highlightingRules)
-        {
-            auto m = rule.pattern.match(line, i);
+    lexText_ = buffer_->snapshot();
+    applied_.fill(false, lexText_.lineCount());
 
-            if (m.hasMatch() && m.capturedStart() == i)
-            {
-                tokens.append({ m.captured(), rule.format.foreground().color() });
-                i += m.capturedLength();
-                matched = true;
-                break;
-            }
-        }
+    int first = 0;
+    int last = 0;
+    priorityLines(&first, &last);
+    // The state stored above the screen is the best guess there is.
+    const QTextBlock above = document()->findBlockByNumber(first - 1);
+    const int state = above.isValid() ? qMax(0, above.userState()) : Grammar::kInitialState;
+
+    auto* thread = new QThread;
+    auto* lexer = new BackgroundLexer(grammar_, lexText_, first, last, state);
+    lexer->moveToThread(thread);
+
+    connect(thread, &QThread::started, lexer, &BackgroundLexer::run);
+    connect(lexer, &BackgroundLexer::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, lexer, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
 
-        if (matched)
-            continue;
+    // Batches of a stopped pass may still be queued; the id drops them.
+    const int id = ++lexId_;
+    connect(lexer, &BackgroundLexer::linesReady, this, [this, id](const LexedLines& lines) {
+        if (id != lexId_)
+            return;
+        if (pending_.isEmpty())
+            nextLine_ = lines.firstLine;
+        pending_.append(lines);
+        if (!applyTimer_->isActive())
+            applyTimer_->start();
+    });
+    connect(lexer, &BackgroundLexer::finished, this, [this, id]() {
+        if (id != lexId_)
+            return;
+        lexer_ = nullptr;
+        lexThread_ = nullptr;
+        finishPass();
+    });
 
-        auto start = commentStartExpression.match(line, i);
-        if (start.hasMatch() && start.capturedStart() == i)
-        {
-            tokens.append({ start.captured(), commentFormat.foreground().color() });
-            i += start.capturedLength();
-            continue;
+    lexer_ = lexer;
+    lexThread_ = thread;
+    lexing_ = true;
+    thread->start();
+}
+
+void codehighlighter::applyCached(const TextSnapshot& text, const LexedLines& lines,
+                                  const QByteArray& textHash)
+{
+    stopBackground();
+    const int count = lines.lineCount();
+    if (!buffer_ || !document() || lines.firstLine != 0 || count != text.lineCount()) {
+        rehighlightInBackground();
+        return;
+    }
+
+    // Applied like the batches of a pass: what is on screen, then the rest.
+    lexText_ = text;
+    applied_.fill(false, count);
+    int first = 0;
+    int last = 0;
+    priorityLines(&first, &last);
+    last = qMin(last, count);
+    first = qMin(first, last);
+    for (const auto& [from, to] : { std::pair(first, last), std::pair(0, first), std::pair(last, count) }) {
+        if (to > from)
+            pending_.append(sliceLines(lines, from, to));
+    }
+    if (!pending_.isEmpty()) {
+        nextLine_ = pending_.first().firstLine;
+        applyTimer_->start();
+    }
+
+    verifyText_ = text;
+    verifyExpected_ = textHash;
+    verifyHash_ = std::make_unique<QCryptographicHash>(QCryptographicHash::Sha1);
+    verified_ = 0;
+    verifyTimer_->start();
+}
+
+void codehighlighter::verifySlice()
+{
+    QElapsedTimer clock;
+    clock.start();
+    const qint64 length = verifyText_.length();
+    while (verified_ < length && !overBudget(clock)) {
+        const qint64 n = qMin(kVerifyChars, length - verified_);
+        HighlightCache::addToHash(*verifyHash_, verifyText_, verified_, n);
+        verified_ += n;
+    }
+    if (verified_ < length) {
+        verifyTimer_->start();
+        return;
+    }
+
+    const bool match = verifyHash_->result() == verifyExpected_;
+    verifyHash_.reset();
+    verifyText_ = TextSnapshot();
+    if (!match)
+        rehighlightInBackground();
+}
+
+bool codehighlighter::isHighlighting() const
+{
+    return lexThread_ || !pending_.isEmpty();
+}
+
+void codehighlighter::setVisibleLines(int first, int last)
+{
+    if (first != visibleFirst_)
+        scrollDirection_ = first > visibleFirst_ ? 1 : -1;
+    visibleFirst_ = first;
+    visibleLast_ = last;
+
+    // Lines scrolled into view before the pass got to them are lexed in
+    // place; the pass corrects them if the guessed state was wrong. So are
+    // those a sweep has not got to yet. Lines an earlier report already
+    // coloured, and whose tokens are still current, are left alone, so
+    // scrolling back and forth during a load stays within the budget.
+    const bool highlighting = deferred_ || isHighlighting();
+    if (!highlighting && !isSweeping())
+        return;
+    QTextBlock block = document()->findBlockByNumber(first);
+    for (int line = first; line < last && block.isValid(); ++line, block = block.next()) {
+        if (highlighting && (deferred_ || line >= applied_.size() || !applied_.testBit(line))) {
+            const auto* data = static_cast<const BlockTokens*>(block.userData());
+            if (!cachedTokens(block) || data->theme != theme_)
+                rehighlightBlock(block);
+        } else if (isSweeping()) {
+            sweepBlock(block, sweepLexes_);
         }
+    }
+}
+
+void codehighlighter::priorityLines(int* first, int* last) const
+{
+    // A screen and a half ahead in the scroll direction, half a screen
+    // behind.
+    const int rows = qMax(1, visibleLast_ - visibleFirst_);
+    const int ahead = rows + rows / 2;
+    const int behind = rows / 2;
+    *first = qMax(0, visibleFirst_ - (scrollDirection_ > 0 ? behind : ahead));
+    *last = visibleLast_ + (scrollDirection_ > 0 ? ahead : behind);
+}
 
-        auto end = commentEndExpression.match(line, i);
-        if (end.hasMatch() && end.capturedStart() == i)
-        {
-            tokens.append({ end.captured(), commentFormat.foreground().color() });
-            i += end.capturedLength();
-            continue;
+void codehighlighter::applyPending()
+{
+    // Edited since the snapshot: the line numbers no longer match.
+    if (!buffer_ || !(buffer_->snapshot() == lexText_)) {
+        stopBackground();
+        restartTimer_->start();
+        return;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+    while (!pending_.isEmpty() && !overBudget(clock)) {
+        const LexedLines& batch = pending_.first();
+        const int end = batch.firstLine + batch.lineCount();
+        QTextBlock block = document()->findBlockByNumber(nextLine_);
+
+        applying_ = &batch;
+        while (nextLine_ < end && block.isValid() && !overBudget(clock)) {
+            lastApplied_ = nextLine_;
+            rehighlightBlock(block);
+            for (; nextLine_ <= lastApplied_ && block.isValid(); ++nextLine_)
+                block = block.next();
         }
+        applying_ = nullptr;
 
-        tokens.append({ QString(line[i]), Qt::gray });
-        i++;
+        if (nextLine_ >= end || !block.isValid()) {
+            pending_.removeFirst();
+            if (!pending_.isEmpty())
+                nextLine_ = pending_.first().firstLine;
+        }
     }
 
+    if (!pending_.isEmpty())
+        applyTimer_->start();
+    else
+        finishPass();
+}
+
+void codehighlighter::finishPass()
+{
+    if (!lexing_ || lexThread_ || !pending_.isEmpty())
+        return;
+    lexing_ = false;
+    emit passFinished();
+}
+
+void codehighlighter::stopBackground()
+{
+    sweepTimer_->stop();
+    sweepCursor_ = QTextCursor();
+    sweepLexes_ = false;
+    restartTimer_->stop();
+    applyTimer_->stop();
+    verifyTimer_->stop();
+    verifyHash_.reset();
+    verifyText_ = TextSnapshot();
+    pending_.clear();
+    applying_ = nullptr;
+    lexing_ = false;
+    ++lexId_;
+
+    if (!lexThread_)
+        return;
+    if (lexer_)
+        lexer_->cancel();
+    lexThread_->quit();
+    lexThread_->wait();
+    lexer_ = nullptr;
+    lexThread_ = nullptr;
+}
+
+TokenSpan codehighlighter::highlightLine(QStringView line, int state) const
+{
+    thread_local QVector<Token> tokens;
+    tokens.clear();   // keeps the capacity
+    grammar_->tokenize(line, state, tokens);
     return tokens;
 }
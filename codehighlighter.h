@@ -2,13 +2,46 @@
 #define CODEHIGHLIGHTER_H
 #pragma once
 #include <QSyntaxHighlighter>
+#include <QTextBlock>
 #include <QTextCharFormat>
-#include <QRegularExpression>
+#include <QTextCursor>
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPointer>
 #include <QVector>
+#include <memory>
+#include "backgroundlexer.h"
+#include "cpplexer.h"
+#include "grammar.h"
+#include "textbuffer.h"
 
-struct MiniToken{
-    QString text;
-    QColor color;
+class QThread;
+class QTimer;
+struct HighlightTheme;
+
+// Tokens of one block as last lexed. They stay valid while the block's
+// text (revision and length) and the state it is entered with are
+// unchanged, and are read by both the editor formats and the minimap.
+class BlockTokens : public QTextBlockUserData {
+public:
+    int revision = -1;
+    int length = -1;
+    int inState = -1;
+    int outState = 0;
+    const HighlightTheme* theme = nullptr;   // formats last set from
+    QVector<Token> tokens;
+};
+
+// Character formats for each token class in one colour scheme. There is
+// one per theme for the whole process, built on first use; highlighters
+// only point at one, so neither a new tab nor a theme switch builds any.
+struct HighlightTheme {
+    QTextCharFormat formats[kTokenClassCount];
+
+    const QTextCharFormat& format(TokenClass cls) const { return formats[int(cls)]; }
+    static const HighlightTheme& get(bool darkMode);
 };
 
 class codehighlighter : public QSyntaxHighlighter{
@@ -16,33 +49,128 @@ class codehighlighter : public QSyntaxHighlighter{
 
 public:
     explicit codehighlighter(QTextDocument* parent = nullptr, bool darkMode = true);
+    ~codehighlighter() override;
+
+    // GUI thread time, in milliseconds, colouring may take before it
+    // returns to the event loop; lines off screen are left for the next
+    // slice. Shared by every highlighter. 0 lifts the cap.
+    static constexpr int kDefaultTimeBudgetMs = 4;
+    static void setTimeBudget(int ms);
+    static int timeBudget() { return timeBudgetMs_; }
 
+    // Swaps the palette without lexing again: blocks keep their token
+    // classes and only their formats are set anew, visible lines first.
     void setDarkMode(bool enabled);
-    QVector<MiniToken> highlightLine(const QString& line) const;
+    bool isDarkMode() const { return darkMode_; }
+    // Blocks off screen are still being lexed in slices, or given the new
+    // theme's formats.
+    bool isSweeping() const;
+    QColor color(TokenClass cls) const { return theme_->format(cls).foreground().color(); }
+
+    // Tokens of one line entered in state, for text that has no block.
+    // They are kept in a per-thread buffer that only grows, so this does
+    // not allocate once it has held the longest line's tokens; the span is
+    // valid until the next call on the same thread.
+    TokenSpan highlightLine(QStringView line, int state = Grammar::kInitialState) const;
+
+    // The language, chosen by file extension when the document is opened.
+    // Changing it drops the cached tokens and lexes the document again.
+    void setGrammar(const Grammar* grammar);
+    const Grammar* grammar() const { return grammar_; }
+
+    // The cached tokens of block, or null when it has not been lexed since
+    // it or the state before it changed.
+    static const QVector<Token>* cachedTokens(const QTextBlock& block);
+
+    // Mirror of the document, snapshotted for background passes.
+    void setBuffer(const TextBuffer* buffer) { buffer_ = buffer; }
+
+    // Re-lexes the whole document on a worker thread, lines on screen
+    // first, and applies the result in slices of the time budget so the
+    // GUI stays responsive. Small documents are lexed in place, in slices
+    // as well.
+    void rehighlightInBackground();
+    bool isHighlighting() const;
+
+    // Colours the document from tokens lexed in an earlier session (see
+    // HighlightCache) without lexing it, lines on screen first. text is
+    // the text they are meant for; it is hashed afterwards, a slice at a
+    // time, and the document is lexed again if it does not match textHash.
+    void applyCached(const TextSnapshot& text, const LexedLines& lines, const QByteArray& textHash);
+
+    // Lines [first, last) are on screen in the view last scrolled. They and
+    // a margin in the scroll direction are coloured first.
+    void setVisibleLines(int first, int last);
+
+    // For bulk loads: while deferred, text inserted away from the visible
+    // lines is left uncoloured for the next background pass.
+    void setDeferred(bool deferred) { deferred_ = deferred; }
+
+signals:
+    // A background pass has lexed and coloured the whole document.
+    void passFinished();
 
 protected:
     void highlightBlock(const QString& text) override;
 
 private:
-    struct HighlightingRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-    QVector<HighlightingRule> highlightingRules;
-
-    QTextCharFormat keywordFormat;
-    QTextCharFormat commentFormat;
-    QTextCharFormat stringFormat;
-    QTextCharFormat classFormat;
-    QTextCharFormat methodFormat;
-    QTextCharFormat variableFormat;
-    QTextCharFormat numberFormat;
-    QRegularExpression commentStartExpression;
-    QRegularExpression commentEndExpression;
-    QTextCharFormat preprocessorFormat;
-    QTextCharFormat parameterFormat;
-
-    void setupRules(bool darkMode);
+    static int timeBudgetMs_;
+
+    const HighlightTheme* theme_ = nullptr;
+    const Grammar* grammar_ = Grammar::cpp();
+    bool darkMode_ = true;
+
+    const TextBuffer* buffer_ = nullptr;
+    bool deferred_ = false;
+    int visibleFirst_ = 0;
+    int visibleLast_ = 100;   // until a view reports
+    int scrollDirection_ = 1;
+
+    // Background pass
+    QPointer<BackgroundLexer> lexer_;
+    QPointer<QThread> lexThread_;
+    int lexId_ = 0;
+    TextSnapshot lexText_;       // what the pass is lexing
+    QList<LexedLines> pending_;  // batches not yet applied
+    int nextLine_ = 0;           // next line of pending_.first() to apply
+    QBitArray applied_;          // lines the pass has coloured
+    const LexedLines* applying_ = nullptr;   // batch being applied
+    int lastApplied_ = -1;                   // furthest line of it coloured so far
+    QTimer* applyTimer_;
+    QTimer* restartTimer_;
+    bool lexing_ = false;        // the pass lexes, rather than applies a cache entry
+
+    // Check of a cache entry being applied
+    TextSnapshot verifyText_;
+    QByteArray verifyExpected_;
+    std::unique_ptr<QCryptographicHash> verifyHash_;
+    qint64 verified_ = 0;        // characters hashed so far
+    QTimer* verifyTimer_;
+
+    // Sweep to the end of the document, a slice at a time: lexing the
+    // blocks left behind, or restyling after a theme switch. The cursor
+    // is the next block and follows edits; it is null when idle.
+    QTextCursor sweepCursor_;
+    bool sweepLexes_ = false;
+    QTimer* sweepTimer_;
+
+    // Time taken in the current event loop iteration. Once it is over the
+    // budget, blocks off screen that a state change cascades to are left
+    // for the sweep.
+    QElapsedTimer budgetClock_;
+    QTimer* budgetTimer_;
+
+    void priorityLines(int* first, int* last) const;
+    void applyPending();
+    void finishPass();
+    void stopBackground();
+    void verifySlice();
+    void startSweep(const QTextBlock& from, bool lex);
+    void sweepBlock(const QTextBlock& block, bool lex);
+    void sweepSlice();
+    void startBudget();
+    static bool overBudget(const QElapsedTimer& clock);
+    bool deferBlock(const QTextBlock& block, const BlockTokens* data);
 };
 
 #endif // CODEHIGHLIGHTER_H
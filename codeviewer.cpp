@@ -1,19 +1,59 @@
 #include "codeviewer.h"
 #include "codeeditor.h"
 #include "codehighlighter.h"
+#include "fileloader.h"
+#include "documentwriter.h"
+#include "gzipsource.h"
 
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QFileDialog>
 #include <qscrollbar.h>
 #include <qtoolbutton.h>
 #include <QLabel>
+#include <QTextBlock>
+#include <utility>
+
+// Files at or above this size skip QPlainTextEdit and open in LargeFileView.
+static constexpr qint64 kLargeFileThreshold = 32 * 1024 * 1024;
+// Documents above this many characters are written on a background thread.
+static constexpr int kBackgroundSaveChars = 4 * 1024 * 1024;
+// Follow mode: wait this long after a change so bursts of writes are read
+// together, read at most this much per pass, and poll this often while a
+// rotated file has not been recreated yet.
+static constexpr int kFollowDelayMs = 100;
+static constexpr qint64 kFollowChunkBytes = 4 * 1024 * 1024;
+static constexpr int kFollowRetryMs = 1000;
+
+static bool isBinaryFile(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray head = file.read(TextDecoder::kSniffBytes);
+    return TextDecoder::looksBinary(head.constData(), head.size());
+}
+
+// In the hex view, hex digits ("4d 5a 90") search for those bytes and
+// anything else for its UTF-8 text.
+static QByteArray hexSearchPattern(const QString& text)
+{
+    QString digits = text;
+    digits.remove(QLatin1Char(' '));
+
+    static const QRegularExpression hex("^([0-9a-fA-F]{2})+$");
+    if (hex.match(digits).hasMatch())
+        return QByteArray::fromHex(digits.toLatin1());
+    return text.toUtf8();
+}
 
 CodeViewer::CodeViewer(QWidget* parent)
     : QWidget(parent),
     editor_(new CodeEditor(this)),
-    highlighter_(new codehighlighter(editor_->document(), false))
+    highlighter_(nullptr)
 {
     editor_->setReadOnly(true);
     editor_->setFont(QFont("Consolas", 11));
@@ -122,23 +162,45 @@ CodeViewer::CodeViewer(QWidget* parent)
                 showReplaceBtn->setText(checked ? "Replace ▲" : "Replace ▼");
             });
 
-    // Insert Find + Replace bars
+    // --- LOAD PROGRESS BAR ---
+    loadBar_ = new QWidget(this);
+    loadBar_->setVisible(false);
+
+    QHBoxLayout* loadLayout = new QHBoxLayout(loadBar_);
+    loadLayout->setContentsMargins(4, 2, 4, 2);
+
+    loadProgress_ = new QProgressBar(loadBar_);
+    loadProgress_->setRange(0, 1000);
+    loadProgress_->setTextVisible(false);
+    loadProgress_->setMaximumHeight(8);
+    loadLayout->addWidget(loadProgress_);
+
+    QToolButton* cancelLoadBtn = new QToolButton(loadBar_);
+    cancelLoadBtn->setText("Cancel");
+    cancelLoadBtn->setToolTip("Stop loading this file");
+    loadLayout->addWidget(cancelLoadBtn);
+
+    connect(cancelLoadBtn, &QToolButton::clicked, this, &CodeViewer::cancelLoad);
+
+    // Insert Find + Replace + Load bars
     layout->insertWidget(0, findbar_);
     layout->insertWidget(1, replaceBar_);
+    layout->insertWidget(2, loadBar_);
 
     // --- MINIMAP + EDITOR ---
     minimap_ = new MiniMap(this);
     minimap_->syncToEditor(editor_);
-    minimap_->setHighlighter(highlighter_);
     minimap_->setFixedWidth(120); // CHANGE THE WIDTH OF THE MINIMAP HERE
     minimap_->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Expanding);
 
-    QHBoxLayout* hLayout = new QHBoxLayout();
-    hLayout->setContentsMargins(0,0,0,0);
-    hLayout->addWidget(editor_);
-    hLayout->addWidget(minimap_);
+    editorLayout_ = new QHBoxLayout();
+    editorLayout_->setContentsMargins(0,0,0,0);
+    editorLayout_->addWidget(editor_);
+    editorLayout_->addWidget(minimap_);
+
+    layout->addLayout(editorLayout_);
 
-    layout->addLayout(hLayout);
+    setDocument(std::make_shared<SharedDocument>());
 
     // INITIAL VISIBLE REGION
     minimap_->updateVisibleRegion(
@@ -146,6 +208,11 @@ CodeViewer::CodeViewer(QWidget* parent)
         // editor_->verticalScrollBar()->pageStep()
         );
 
+    // Background highlighting starts with what this view shows.
+    connect(editor_->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        highlighter_->setVisibleLines(value, value + editor_->verticalScrollBar()->pageStep() + 1);
+    });
+
     // SCROLL SYNC
     // connect(editor_->verticalScrollBar(), &QScrollBar::rangeChanged,
     //         this, [this]() {
@@ -165,18 +232,463 @@ CodeViewer::CodeViewer(QWidget* parent)
     setDarkMode(false);
 }
 
+CodeViewer::~CodeViewer()
+{
+    stopLoader();
+    stopCacheReader();
+
+    // Let a running save finish; it only ever touches its temp file.
+    if (saveThread_)
+        saveThread_->wait();
+}
+
+bool CodeViewer::recoverFile(const QString& path, const QVector<EditJournal::Operation>& operations)
+{
+    loadFile(path);
+    if (!isLoading())
+        return false;
+    recovery_ = operations;
+    return true;
+}
+
 void CodeViewer::loadFile(const QString& path)
 {
-    QFile file(path);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        editor_->setPlainText(in.readAll());
+    stopLoader();
+    stopCacheReader();
+    if (isFollowing() && path != filePath_)
+        setFollowing(false);
+
+    filePath_ = path;
+    recovery_.clear();
+    restorePending_ = false;
+    loadedBytes_ = 0;
+
+    // Another viewer has the file loaded already: show its document.
+    const std::shared_ptr<SharedDocument> shared = DocumentRegistry::find(path);
+    if (shared && shared != doc_ && !isFollowing()) {
+        partial_ = false;
+        setDocument(shared);
+        return;
     }
+
+    // The current document may be shown elsewhere; start a new one.
+    setDocument(std::make_shared<SharedDocument>());
+
+    // Compressed files are always streamed, whatever their size on disk;
+    // other binaries never go through the text decoder.
+    const bool compressed = GzipSource::isCompressed(path);
+    if (!compressed && isBinaryFile(path) && openHexView(path))
+        return;
+    if ((compressed || QFileInfo(path).size() >= kLargeFileThreshold) && openLargeFile(path))
+        return;
+
+    DocumentRegistry::add(path, doc_);
+    doc_->setPath(path);
+    readHighlightCache(path);
+
+    // Read + decode on a worker; the document is filled chunk by chunk.
+    editor_->clear();
+    editor_->document()->setUndoRedoEnabled(false);
+    editor_->setReadOnly(true);
+    minimap_->setUpdatesEnabled(false);
+    partial_ = false;
+    // Only the first screen is coloured as chunks arrive; the rest is
+    // lexed on a worker once the file is in.
+    highlighter_->setDeferred(true);
+
+    loadProgress_->setValue(0);
+    loadBar_->setVisible(true);
+
+    auto* thread = new QThread;
+    auto* loader = new FileLoader(path);
+    loader->moveToThread(thread);
+
+    connect(thread, &QThread::started, loader, &FileLoader::run);
+    connect(loader, &FileLoader::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, loader, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    // Queued signals from a cancelled loader may still arrive; the id drops them.
+    const int id = ++loadId_;
+    connect(loader, &FileLoader::chunkReady, this, [this, id, credits = loader->credits()](const QString& text) {
+        if (id == loadId_)
+            appendChunk(text);
+        credits->release();
+    });
+    connect(loader, &FileLoader::formatDetected, this, [this, id](const TextFormat& format) {
+        if (id == loadId_)
+            doc_->setFormat(format);
+    });
+    connect(loader, &FileLoader::finished, this, [this, id](bool completed) {
+        if (id == loadId_)
+            onLoadFinished(completed);
+    });
+    connect(loader, &FileLoader::progress, this, [this, id](qint64 done, qint64 total) {
+        if (id != loadId_)
+            return;
+        loadedBytes_ = done;
+        if (total > 0)
+            loadProgress_->setValue(int(done * 1000 / total));
+    });
+
+    loader_ = loader;
+    loaderThread_ = thread;
+    thread->start();
+}
+
+void CodeViewer::stopLoader()
+{
+    if (!loaderThread_)
+        return;
+
+    if (loader_)
+        loader_->cancel();
+
+    loaderThread_->quit();
+    loaderThread_->wait();
+    ++loadId_;
+
+    loader_ = nullptr;
+    loaderThread_ = nullptr;
+    loadBar_->setVisible(false);
+    minimap_->setUpdatesEnabled(true);
+}
+
+void CodeViewer::readHighlightCache(const QString& path)
+{
+    if (QFileInfo(path).size() < HighlightCache::kMinFileSize)
+        return;
+
+    auto* thread = new QThread;
+    auto* reader = new HighlightCacheReader(path);
+    reader->moveToThread(thread);
+
+    connect(thread, &QThread::started, reader, &HighlightCacheReader::run);
+    connect(reader, &HighlightCacheReader::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, reader, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    const int id = ++cacheId_;
+    connect(reader, &HighlightCacheReader::finished, this,
+            [this, id](bool ok, const HighlightCache::Entry& entry) {
+        if (id != cacheId_)
+            return;
+        cacheThread_ = nullptr;
+        cacheEntry_ = entry;
+        haveCacheEntry_ = ok;
+        if (cacheWaiting_) {
+            cacheWaiting_ = false;
+            startHighlighting();
+        }
+    });
+
+    cacheThread_ = thread;
+    thread->start();
+}
+
+void CodeViewer::stopCacheReader()
+{
+    // Reading an entry cannot be interrupted, but it is short.
+    if (cacheThread_) {
+        cacheThread_->quit();
+        cacheThread_->wait();
+        cacheThread_ = nullptr;
+    }
+    ++cacheId_;
+    cacheEntry_ = HighlightCache::Entry();
+    haveCacheEntry_ = false;
+    cacheWaiting_ = false;
+}
+
+void CodeViewer::startHighlighting()
+{
+    // An entry for the file as loaded colours it without lexing; it is
+    // checked against the text afterwards.
+    if (haveCacheEntry_ && cacheEntry_.grammar == highlighter_->grammar()->name())
+        highlighter_->applyCached(loadedText_, cacheEntry_.lines, cacheEntry_.textHash);
+    else
+        highlighter_->rehighlightInBackground();
+    cacheEntry_ = HighlightCache::Entry();
+    haveCacheEntry_ = false;
+    loadedText_ = TextSnapshot();
+}
+
+void CodeViewer::cancelLoad()
+{
+    if (!loaderThread_)
+        return;
+
+    stopLoader();
+    onLoadFinished(false);
+}
+
+void CodeViewer::appendChunk(const QString& text)
+{
+    QTextCursor cursor(editor_->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text);
+}
+
+void CodeViewer::onLoadFinished(bool completed)
+{
+    loader_ = nullptr;
+    loaderThread_ = nullptr;
+    partial_ = !completed;
+
+    loadBar_->setVisible(false);
+
+    QTextDocument* doc = editor_->document();
+    doc->setUndoRedoEnabled(!isFollowing());
+    doc->setModified(false);
+
+    // Cached colours are only for the file exactly as it is on disk.
+    loadedText_ = snapshot();
+    if (!completed || isFollowing() || !recovery_.isEmpty())
+        stopCacheReader();
+
+    if (completed && !filePath_.isEmpty() && !isFollowing()) {
+        // Edits from a crashed session go on top of the file as loaded.
+        if (!recovery_.isEmpty()) {
+            EditJournal::apply(doc, recovery_);
+            doc->setModified(true);
+        }
+
+        doc_->setJournal(new EditJournal(filePath_));
+        doc_->journal()->start(recovery_);
+        recovery_.clear();
+    }
+    doc_->setShareable(completed && !isFollowing());
+
+    highlighter_->setDeferred(false);
+    if (cacheThread_)
+        cacheWaiting_ = true;
+    else
+        startHighlighting();
+
+    // A cancelled load only holds part of the file; keep it read-only.
+    setReadOnly(readOnlyRequested_ || partial_);
+
+    minimap_->setUpdatesEnabled(true);
+    minimap_->update();
+
+    applyViewState();
+
+    if (isFollowing()) {
+        if (completed)
+            readAppended();   // catch up with what was written meanwhile
+        else
+            setFollowing(false);
+    }
+}
+
+bool CodeViewer::setFollowing(bool enabled)
+{
+    if (enabled == isFollowing())
+        return true;
+
+    if (!enabled) {
+        delete watcher_;
+        watcher_ = nullptr;
+        delete followTimer_;
+        followTimer_ = nullptr;
+
+        if (!largeView_ && !hexView_ && !isLoading() && !partial_) {
+            editor_->document()->setUndoRedoEnabled(true);
+            doc_->setJournal(new EditJournal(filePath_));
+            doc_->journal()->start();
+            doc_->setShareable(true);
+        }
+        setReadOnly(readOnlyRequested_);
+        return true;
+    }
+
+    if (filePath_.isEmpty() || partial_ || editor_->document()->isModified())
+        return false;
+    if ((largeView_ && largeView_->isCompressed()) || hexView_)
+        return false;
+    // Appending would change the document under the other viewers too.
+    if (doc_.use_count() > 1)
+        return false;
+
+    // Appends are cut at line ends, which is only safe for byte encodings.
+    QFile file(filePath_);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray head = file.read(64 * 1024);
+    followEncoding_ = TextDecoder::detect(head.constData(), head.size());
+    if (followEncoding_ == TextDecoder::Utf16LE || followEncoding_ == TextDecoder::Utf16BE)
+        return false;
+
+    watcher_ = new QFileSystemWatcher(QStringList{ filePath_ }, this);
+    connect(watcher_, &QFileSystemWatcher::fileChanged, this, [this]() {
+        if (!followTimer_->isActive())
+            followTimer_->start(kFollowDelayMs);
+    });
+
+    followTimer_ = new QTimer(this);
+    followTimer_->setSingleShot(true);
+    connect(followTimer_, &QTimer::timeout, this, &CodeViewer::readAppended);
+
+    // Nothing to recover in a read-only view that tracks the file.
+    if (doc_->journal()) {
+        doc_->journal()->discard();
+        doc_->setJournal(nullptr);
+    }
+    doc_->setShareable(false);
+    editor_->document()->setUndoRedoEnabled(false);
+    setReadOnly(readOnlyRequested_);
+
+    if (largeView_)
+        largeView_->scrollToEnd();
+    else if (!isLoading())
+        readAppended();
+    return true;
+}
+
+void CodeViewer::readAppended()
+{
+    if (!isFollowing() || isLoading())
+        return;
+
+    // Rotation (rename, then a new file) drops the path from the watcher.
+    if (!watcher_->files().contains(filePath_)) {
+        if (!QFileInfo::exists(filePath_)) {
+            followTimer_->start(kFollowRetryMs);
+            return;
+        }
+        watcher_->addPath(filePath_);
+
+        if (largeView_) {
+            largeView_->openFile(filePath_);
+            largeView_->scrollToEnd();
+        } else {
+            loadFile(filePath_);
+        }
+        return;
+    }
+
+    if (largeView_) {
+        largeView_->refresh();
+        return;
+    }
+
+    QFile file(filePath_);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    const qint64 size = file.size();
+    if (size < loadedBytes_) {
+        loadFile(filePath_);   // truncated
+        return;
+    }
+    if (size == loadedBytes_ || !file.seek(loadedBytes_))
+        return;
+
+    // Whole lines only: a line still being written is read next time, so
+    // no multi-byte sequence or CRLF is split. Lines longer than a chunk
+    // are the exception.
+    QByteArray bytes = file.read(qMin(size - loadedBytes_, kFollowChunkBytes));
+    qsizetype end = bytes.lastIndexOf('\n') + 1;
+    if (end == 0 && bytes.size() == kFollowChunkBytes)
+        end = bytes.size();
+    if (end == 0)
+        return;
+    bytes.truncate(end);
+    loadedBytes_ += end;
+
+    QString text = TextDecoder(followEncoding_).feed(bytes);
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+
+    QScrollBar* sb = editor_->verticalScrollBar();
+    const bool atBottom = sb->value() == sb->maximum();
+
+    appendChunk(text);
+    editor_->document()->setModified(false);
+
+    if (atBottom)
+        sb->setValue(sb->maximum());
+
+    if (loadedBytes_ < size)
+        followTimer_->start(0);
+}
+
+void CodeViewer::setDocument(std::shared_ptr<SharedDocument> doc)
+{
+    // The old document lives until the editor has switched away from it.
+    const std::shared_ptr<SharedDocument> old = std::exchange(doc_, std::move(doc));
+
+    editor_->setDocument(doc_->document());
+    highlighter_ = doc_->highlighter();
+    if (highlighter_->isDarkMode() != darkMode_)
+        highlighter_->setDarkMode(darkMode_);
+
+    minimap_->setDocument(doc_->document());
+    minimap_->setHighlighter(highlighter_);
+    minimap_->setBuffer(&doc_->buffer());
+    minimap_->setSharedCache(doc_->miniMapCache());
+
+    editor_->updateLineNumberAreaWidth(0);
+    setReadOnly(readOnlyRequested_);
+}
+
+bool CodeViewer::openLargeFile(const QString& path)
+{
+    if (!largeView_) {
+        largeView_ = new LargeFileView(this);
+        editorLayout_->insertWidget(0, largeView_);
+    }
+
+    if (!largeView_->openFile(path)) {
+        editorLayout_->removeWidget(largeView_);
+        largeView_->deleteLater();
+        largeView_ = nullptr;
+        return false;
+    }
+
+    // The mapped view replaces the editor; only the visible lines are decoded.
+    editor_->clear();
+    editor_->hide();
+    minimap_->hide();
+    largeView_->setDarkMode(darkMode_);
+    largeView_->show();
+    return true;
+}
+
+bool CodeViewer::openHexView(const QString& path)
+{
+    if (!hexView_) {
+        hexView_ = new HexView(this);
+        editorLayout_->insertWidget(0, hexView_);
+        connect(hexView_, &HexView::searchFinished, this, [this](bool found) {
+            matchCountLabel_->setText(found ? "Found" : "No match");
+        });
+    }
+
+    if (!hexView_->openFile(path)) {
+        editorLayout_->removeWidget(hexView_);
+        hexView_->deleteLater();
+        hexView_ = nullptr;
+        return false;
+    }
+
+    editor_->clear();
+    editor_->hide();
+    minimap_->hide();
+    hexView_->setDarkMode(darkMode_);
+    hexView_->show();
+    return true;
 }
 
 void CodeViewer::setDarkMode(bool enabled)
 {
-    if (highlighter_) {
+    darkMode_ = enabled;
+    if (largeView_)
+        largeView_->setDarkMode(enabled);
+    if (hexView_)
+        hexView_->setDarkMode(enabled);
+
+    // Views sharing the document share the highlighter; restyle once.
+    if (highlighter_ && highlighter_->isDarkMode() != enabled) {
         highlighter_->setDarkMode(enabled);
     }
 
@@ -203,6 +715,11 @@ void CodeViewer::setDarkMode(bool enabled)
 
 void CodeViewer::setReadOnly(bool enabled)
 {
+    readOnlyRequested_ = enabled;
+
+    if (largeView_ || hexView_ || isLoading() || partial_ || isFollowing())
+        enabled = true;
+
     editor_->setReadOnly(enabled);
 
     if (enabled) {
@@ -217,13 +734,83 @@ bool CodeViewer::save()
     if (filePath_.isEmpty())
         return false; // should call Save As instead
 
-    QFile file(filePath_);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    if (largeView_ || hexView_ || isLoading() || partial_)
+        return false; // large, binary or partially loaded files are read-only
+
+    // Saving over the file would write U+FFFD where its invalid bytes were.
+    if (doc_->format().lossy) {
+        emit saveFinished(false, "Parts of the file are not valid UTF-8 and were replaced when it was "
+                                 "opened; saving would destroy the original bytes. Use Save As to "
+                                 "write a new file.");
         return false;
+    }
 
-    QTextStream out(&file);
-    out << editor_->toPlainText();
-    return true;
+    QTextDocument* doc = editor_->document();
+
+    if (isSaving()) {
+        saveAgain_ = true;
+        return true;
+    }
+
+    if (doc->characterCount() > kBackgroundSaveChars) {
+        saveInBackground();
+        return true;
+    }
+
+    if (doc_->journal())
+        doc_->journal()->beginSave();
+
+    QString error;
+    const bool ok = DocumentWriter::write(doc_->documentText(), filePath_, doc_->format(), &error);
+    if (ok) {
+        doc->setModified(false);
+        doc_->markSaved();
+    }
+    if (doc_->journal())
+        doc_->journal()->endSave(ok);
+
+    emit saveFinished(ok, error);
+    return ok;
+}
+
+void CodeViewer::saveInBackground()
+{
+    // Copying the document's text is one pass here; encoding, disk I/O and
+    // the rename all happen on the writer thread so typing is not blocked.
+    QTextDocument* doc = editor_->document();
+    savedRevision_ = doc->revision();
+    if (doc_->journal())
+        doc_->journal()->beginSave();
+
+    auto* thread = new QThread;
+    auto* writer = new DocumentWriter(filePath_, doc_->documentText(), doc_->format());
+    writer->moveToThread(thread);
+
+    connect(thread, &QThread::started, writer, &DocumentWriter::run);
+    connect(writer, &DocumentWriter::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, writer, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    connect(writer, &DocumentWriter::finished, this, [this](bool ok, const QString& error) {
+        saveThread_ = nullptr;
+
+        QTextDocument* doc = editor_->document();
+        if (ok)
+            doc_->markSaved();
+        if (ok && doc->revision() == savedRevision_)
+            doc->setModified(false);
+        if (doc_->journal())
+            doc_->journal()->endSave(ok);
+        emit saveFinished(ok, error);
+
+        if (saveAgain_) {
+            saveAgain_ = false;
+            save();
+        }
+    });
+
+    saveThread_ = thread;
+    thread->start();
 }
 
 bool CodeViewer::saveAs(QWidget* parent)
@@ -232,8 +819,26 @@ bool CodeViewer::saveAs(QWidget* parent)
     if (newPath.isEmpty())
         return false;
 
+    // A new file loses nothing; the original keeps its bytes.
+    if (newPath != filePath_) {
+        TextFormat format = doc_->format();
+        format.lossy = false;
+        doc_->setFormat(format);
+    }
     filePath_ = newPath;
-    return save();
+
+    // The journal is keyed by path; start over against the new file.
+    if (doc_->journal()) {
+        doc_->journal()->discard();
+        doc_->setJournal(new EditJournal(filePath_));
+        doc_->journal()->start();
+    }
+
+    // Registered and watched once the new file exists.
+    const bool ok = save();
+    DocumentRegistry::add(filePath_, doc_);
+    doc_->setPath(filePath_);
+    return ok;
 }
 
 void CodeViewer::showFindBar()
@@ -254,6 +859,12 @@ void CodeViewer::findNext()
     QString text = findField_->text();
     if (text.isEmpty()) return;
 
+    if (hexView_) {
+        matchCountLabel_->setText("Searching...");
+        hexView_->findNext(hexSearchPattern(text));
+        return;
+    }
+
     QTextDocument::FindFlags flags;
 
     if (caseSensitive_)
@@ -273,6 +884,12 @@ void CodeViewer::findPrevious()
     QString text = findField_->text();
     if (text.isEmpty()) return;
 
+    if (hexView_) {
+        matchCountLabel_->setText("Searching...");
+        hexView_->findPrevious(hexSearchPattern(text));
+        return;
+    }
+
     QTextDocument::FindFlags flags = QTextDocument::FindBackward;
 
     if (caseSensitive_)
@@ -287,8 +904,105 @@ void CodeViewer::findPrevious()
     updateHighlights();
 }
 
+void CodeViewer::goToLine(qint64 line)
+{
+    if (largeView_) {
+        largeView_->goToLine(line - 1);
+        largeView_->setFocus();
+        return;
+    }
+
+    const int number = int(qBound<qint64>(1, line, editor_->blockCount())) - 1;
+    QTextCursor cursor(editor_->document()->findBlockByNumber(number));
+    editor_->setTextCursor(cursor);
+    editor_->centerCursor();
+    editor_->setFocus();
+}
+
+void CodeViewer::goToOffset(qint64 offset)
+{
+    if (!hexView_)
+        return;
+    hexView_->goToOffset(offset);
+    hexView_->setFocus();
+}
+
+qint64 CodeViewer::lineCount() const
+{
+    if (largeView_)
+        return largeView_->lineCount();
+    return editor_->blockCount();
+}
+
+qint64 CodeViewer::currentLine() const
+{
+    if (largeView_)
+        return largeView_->topLine() + 1;
+    return editor_->textCursor().blockNumber() + 1;
+}
+
+CodeViewer::ViewState CodeViewer::viewState() const
+{
+    ViewState state;
+    state.path = filePath_;
+    state.readOnly = readOnlyRequested_;
+
+    // Still loading: the saved position has not been applied yet.
+    if (restorePending_) {
+        state.cursor = pendingState_.cursor;
+        state.topLine = pendingState_.topLine;
+    } else if (hexView_) {
+        state.cursor = hexView_->currentOffset();
+    } else if (largeView_) {
+        state.topLine = largeView_->topLine();
+    } else {
+        state.cursor = editor_->textCursor().position();
+        state.topLine = editor_->verticalScrollBar()->value();
+    }
+    return state;
+}
+
+void CodeViewer::restoreViewState(const ViewState& state)
+{
+    loadFile(state.path);
+    setReadOnly(state.readOnly);
+
+    pendingState_ = state;
+    restorePending_ = true;
+    // Shared documents and mapped views are ready at once, but the viewer
+    // has not been laid out yet.
+    if (!isLoading())
+        QTimer::singleShot(0, this, &CodeViewer::applyViewState);
+}
+
+void CodeViewer::applyViewState()
+{
+    if (!restorePending_)
+        return;
+    restorePending_ = false;
+
+    if (hexView_) {
+        if (pendingState_.cursor >= 0)
+            hexView_->goToOffset(pendingState_.cursor);
+    } else if (largeView_) {
+        // Lines of a compressed file are only known once it is decompressed.
+        if (!largeView_->isCompressed())
+            largeView_->scrollToLine(pendingState_.topLine);
+    } else {
+        QTextCursor cursor(editor_->document());
+        cursor.setPosition(int(qBound<qint64>(0, pendingState_.cursor, editor_->document()->characterCount() - 1)));
+        editor_->setTextCursor(cursor);
+        // No line wrapping, so the scroll value is the first visible line.
+        editor_->verticalScrollBar()->setValue(int(qMin<qint64>(pendingState_.topLine, INT_MAX)));
+    }
+}
+
 void CodeViewer::updateHighlights()
 {
+    // The hex view reports its own matches.
+    if (hexView_)
+        return;
+
     QList<QTextEdit::ExtraSelection> extraSelections;
 
     QString pattern = findField_->text();
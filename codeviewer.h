@@ -5,35 +5,91 @@
 #include "minimap.h"
 #include "codeeditor.h"
 #include "linenumberarea.h"
+#include "largefileview.h"
+#include "hexview.h"
 #include <QWidget>
 #include <QPlainTextEdit>
 #include "codehighlighter.h"
 #include <QLineEdit>
 #include <QLabel>
+#include <QHBoxLayout>
+#include <QProgressBar>
+#include <QPointer>
+#include <QThread>
+#include "editjournal.h"
+#include "highlightcache.h"
+#include "textbuffer.h"
+#include "textdecoder.h"
+#include "shareddocument.h"
+#include <memory>
+
+class FileLoader;
+class QFileSystemWatcher;
+class QTimer;
 
 class CodeViewer : public QWidget {
     Q_OBJECT
 public:
     explicit CodeViewer(QWidget* parent = nullptr);
+    ~CodeViewer() override;
     void loadFile(const QString& path);
+    // Loads path and replays operations on it once loaded. False if the
+    // file does not open as an editable document of its own (it is shown
+    // by another viewer, or binary, or large), so the edits cannot apply.
+    bool recoverFile(const QString& path, const QVector<EditJournal::Operation>& operations);
+    void cancelLoad();
+    bool isLoading() const { return loaderThread_ != nullptr; }
     void setDarkMode(bool enabled);
     void onTabClosed(int index);
     int lineNumberAreaWidth() const;
     void lineNumberAreaPaintEvent(QPaintEvent* event);
     void setReadOnly(bool enabled);
+    bool isLargeFile() const { return largeView_ != nullptr; }
+    // Binary content (see TextDecoder::looksBinary) opens in a HexView.
+    bool isBinary() const { return hexView_ != nullptr; }
     QString filePath() const { return filePath_; }
     void setFilePath(const QString& path) { filePath_ = path; }
     bool save();
     bool saveAs(QWidget* parent);
+    bool isSaving() const { return saveThread_ != nullptr; }
+    // Follow mode (tail -f): bytes appended to the file are read as they
+    // arrive and added at the end. The view is read-only while following.
+    // Fails for modified documents and UTF-16 files.
+    bool setFollowing(bool enabled);
+    bool isFollowing() const { return watcher_ != nullptr; }
     CodeEditor* editor() const { return editor_; }
+    // Immutable copy of the mirror, safe to hand to worker threads; saving
+    // uses the document itself (SharedDocument::documentText()).
+    TextSnapshot snapshot() const { return doc_->buffer().snapshot(); }
     void showFindBar();
     void hideFindBar();
     void findNext();
     void findPrevious();
+    // 1-based, like the line numbers in the gutter.
+    void goToLine(qint64 line);
+    qint64 lineCount() const;
+    qint64 currentLine() const;
+    // Hex view only: 0-based byte offset.
+    void goToOffset(qint64 offset);
+    qint64 currentOffset() const { return hexView_ ? hexView_->currentOffset() : -1; }
+    // What a session remembers about a tab (see PendingTab).
+    struct ViewState {
+        QString path;
+        qint64 cursor = 0;     // text position; byte offset (-1: none) in the hex view
+        qint64 topLine = 0;    // 0-based first visible line
+        bool readOnly = true;
+    };
+    ViewState viewState() const;
+    // Loads state.path and puts the cursor and scroll position back once
+    // the text is in.
+    void restoreViewState(const ViewState& state);
     void replaceOne();
     void replaceAll();
     int indentLevel(const QString& line) const;
 
+signals:
+    void saveFinished(bool ok, const QString& error);
+
 private:
     CodeEditor* editor_;
     codehighlighter* highlighter_;
@@ -48,6 +104,53 @@ private:
     QLineEdit* replaceField_ = nullptr;
     QWidget* replaceBar_ = nullptr;
     MiniMap* minimap_ = nullptr;
+    QHBoxLayout* editorLayout_ = nullptr;
+    LargeFileView* largeView_ = nullptr;
+    HexView* hexView_ = nullptr;
+    bool darkMode_ = false;
+
+    QWidget* loadBar_ = nullptr;
+    QProgressBar* loadProgress_ = nullptr;
+    QPointer<FileLoader> loader_;
+    QPointer<QThread> loaderThread_;
+    int loadId_ = 0;
+    bool readOnlyRequested_ = true;
+    bool partial_ = false;   // loading was cancelled; saving would truncate
+    QPointer<QThread> saveThread_;
+    int savedRevision_ = -1;
+    bool saveAgain_ = false;
+    QVector<EditJournal::Operation> recovery_;
+    ViewState pendingState_;
+    bool restorePending_ = false;
+    // The document, highlighter, journal and minimap rendering, possibly
+    // shared with other viewers of the same file (see DocumentRegistry).
+    std::shared_ptr<SharedDocument> doc_;
+
+    QFileSystemWatcher* watcher_ = nullptr;
+    QTimer* followTimer_ = nullptr;
+    qint64 loadedBytes_ = 0;     // bytes of the file the document holds
+    TextDecoder::Encoding followEncoding_ = TextDecoder::Utf8;
+
+    // Highlight cache entry of the file being loaded, read alongside it
+    QPointer<QThread> cacheThread_;
+    int cacheId_ = 0;
+    HighlightCache::Entry cacheEntry_;
+    bool haveCacheEntry_ = false;
+    bool cacheWaiting_ = false;  // loaded; colouring waits for the entry
+    TextSnapshot loadedText_;
+
+    bool openLargeFile(const QString& path);
+    bool openHexView(const QString& path);
+    void stopLoader();
+    void readHighlightCache(const QString& path);
+    void stopCacheReader();
+    void startHighlighting();
+    void appendChunk(const QString& text);
+    void onLoadFinished(bool completed);
+    void saveInBackground();
+    void setDocument(std::shared_ptr<SharedDocument> doc);
+    void readAppended();
+    void applyViewState();
 
 };
 
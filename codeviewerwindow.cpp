@@ -1,5 +1,7 @@
 #include "codeviewerwindow.h"
+#include "codehighlighter.h"
 #include "codeviewer.h"
+#include "pendingtab.h"
 
 #include <QFileInfo>
 #include <QTabBar>
@@ -8,6 +10,10 @@
 #include <QVBoxLayout>
 #include <QMenuBar>
 #include <QAction>
+#include <QMessageBox>
+#include <QInputDialog>
+#include <QApplication>
+#include <QSettings>
 
 CodeViewerWindow::CodeViewerWindow(QWidget* parent)
     : QMainWindow(parent),
@@ -48,6 +54,10 @@ CodeViewerWindow::CodeViewerWindow(QWidget* parent)
     findAction->setShortcut(QKeySequence("Ctrl+F"));
     editMenu->addAction(findAction);
 
+    QAction* goToLineAction = new QAction("Go to Line...", this);
+    goToLineAction->setShortcut(QKeySequence("Ctrl+G"));
+    editMenu->addAction(goToLineAction);
+
     // ----- VIEW MENU -----
     QMenu* viewMenu = menu->addMenu("View");
 
@@ -55,6 +65,15 @@ CodeViewerWindow::CodeViewerWindow(QWidget* parent)
     darkModeAction->setCheckable(true);
     viewMenu->addAction(darkModeAction);
 
+    QAction* followAction = new QAction("Follow File", this);
+    followAction->setCheckable(true);
+    followAction->setToolTip("Show lines appended to the file as they are written");
+    viewMenu->addAction(followAction);
+
+    QAction* budgetAction = new QAction("Highlighting Time Budget...", this);
+    budgetAction->setToolTip("Longest the editor spends colouring text before it handles input again");
+    viewMenu->addAction(budgetAction);
+
     QToolBar* editorBar = new QToolBar(this);
     editorBar->setIconSize(QSize(16,16));
     editorBar->setMovable(false);
@@ -115,6 +134,29 @@ CodeViewerWindow::CodeViewerWindow(QWidget* parent)
             }
         }
     });
+    // Follow (tail -f)
+    connect(followAction, &QAction::toggled, this, [this, followAction](bool checked) {
+        auto* viewer = qobject_cast<CodeViewer*>(tabWidget_->currentWidget());
+        if (!viewer || viewer->setFollowing(checked))
+            return;
+
+        QSignalBlocker block(followAction);
+        followAction->setChecked(false);
+        QMessageBox::information(this, "Follow File",
+                                 "Only unmodified files in a single-byte or UTF-8 encoding can be followed.");
+    });
+    // Highlighting time budget
+    connect(budgetAction, &QAction::triggered, this, [this]() {
+        editTimeBudget(this);
+    });
+    // Restored tabs are only loaded once they are looked at.
+    connect(tabWidget_, &QTabWidget::currentChanged, this, &CodeViewerWindow::materializeTab);
+    connect(tabWidget_, &QTabWidget::currentChanged, this, [this, followAction]() {
+        auto* viewer = qobject_cast<CodeViewer*>(tabWidget_->currentWidget());
+        QSignalBlocker block(followAction);
+        followAction->setChecked(viewer && viewer->isFollowing());
+    });
+
     // Search bar
     connect(findAction, &QAction::triggered, this, [this]() {
         if (auto* viewer = qobject_cast<CodeViewer*>(tabWidget_->currentWidget())) {
@@ -122,6 +164,12 @@ CodeViewerWindow::CodeViewerWindow(QWidget* parent)
         }
     });
 
+    // Go to line
+    connect(goToLineAction, &QAction::triggered, this, [this]() {
+        if (auto* viewer = qobject_cast<CodeViewer*>(tabWidget_->currentWidget()))
+            promptGoToLine(viewer, this);
+    });
+
     QWidget* container = new QWidget(this);
 
     QVBoxLayout* layout = new QVBoxLayout(container);
@@ -138,9 +186,66 @@ CodeViewerWindow::CodeViewerWindow(QWidget* parent)
 
 }
 
+void CodeViewerWindow::loadHighlightingSettings()
+{
+    QSettings settings(QApplication::applicationName(), "Settings");
+    codehighlighter::setTimeBudget(settings.value("highlighting/timeBudgetMs",
+                                                  codehighlighter::kDefaultTimeBudgetMs).toInt());
+}
+
+void CodeViewerWindow::editTimeBudget(QWidget* parent)
+{
+    bool ok = false;
+    const int ms = QInputDialog::getInt(parent, "Highlighting Time Budget",
+                                        "Milliseconds per slice (0 for no limit):",
+                                        codehighlighter::timeBudget(), 0, 100, 1, &ok);
+    if (!ok)
+        return;
+    codehighlighter::setTimeBudget(ms);
+    QSettings settings(QApplication::applicationName(), "Settings");
+    settings.setValue("highlighting/timeBudgetMs", ms);
+}
+
+void CodeViewerWindow::promptGoToLine(CodeViewer* viewer, QWidget* parent)
+{
+    // Binary files jump to a byte offset instead: 0x1F00 or decimal.
+    if (viewer->isBinary()) {
+        bool ok = false;
+        const QString text = QInputDialog::getText(parent, "Go to Offset", "Offset (0x for hex):",
+                                                   QLineEdit::Normal,
+                                                   QString("0x%1").arg(qMax<qint64>(0, viewer->currentOffset()), 0, 16),
+                                                   &ok).trimmed();
+        if (!ok)
+            return;
+        const qint64 offset = text.startsWith("0x", Qt::CaseInsensitive)
+            ? text.mid(2).toLongLong(&ok, 16) : text.toLongLong(&ok, 10);
+        if (ok)
+            viewer->goToOffset(offset);
+        return;
+    }
+
+    // Large files report -1 until their line index is built.
+    const qint64 count = viewer->lineCount();
+    const int max = count > 0 ? int(qMin<qint64>(count, INT_MAX)) : INT_MAX;
+
+    bool ok = false;
+    const int line = QInputDialog::getInt(parent, "Go to Line",
+                                          count > 0 ? QString("Line (1 - %1):").arg(count) : QString("Line:"),
+                                          int(viewer->currentLine()), 1, max, 1, &ok);
+    if (ok)
+        viewer->goToLine(line);
+}
+
 void CodeViewerWindow::openFile(const QString& path)
 {
-    CodeViewer* viewer = new CodeViewer(this);
+    // A file that already has a tab just gets focus.
+    const int existing = PendingTab::indexOf(tabWidget_, path);
+    if (existing >= 0) {
+        tabWidget_->setCurrentIndex(existing);
+        return;
+    }
+
+    CodeViewer* viewer = createViewer();
     viewer->loadFile(path);
     viewer->setFilePath(path);
 
@@ -150,8 +255,49 @@ void CodeViewerWindow::openFile(const QString& path)
     setWindowTitle("CodeEditor - " + QFileInfo(path).absolutePath());
 }
 
+CodeViewer* CodeViewerWindow::createViewer()
+{
+    CodeViewer* viewer = new CodeViewer(this);
+    if (darkMode_)
+        viewer->setDarkMode(true);
+
+    connect(viewer, &CodeViewer::saveFinished, this, [this, viewer](bool ok, const QString& error) {
+        if (!ok)
+            QMessageBox::warning(this, "Save failed",
+                                 QString("Could not save %1:\n%2").arg(viewer->filePath(), error));
+    });
+    return viewer;
+}
+
+void CodeViewerWindow::materializeTab(int index)
+{
+    auto* pending = qobject_cast<PendingTab*>(tabWidget_->widget(index));
+    if (!pending)
+        return;
+
+    CodeViewer* viewer = createViewer();
+    viewer->restoreViewState(pending->state());
+    PendingTab::replace(tabWidget_, index, viewer);
+
+    setWindowTitle("CodeEditor - " + QFileInfo(viewer->filePath()).absolutePath());
+}
+
+void CodeViewerWindow::saveSession(QSettings& settings, const QString& group) const
+{
+    PendingTab::saveTabs(settings, group, tabWidget_);
+}
+
+bool CodeViewerWindow::restoreSession(QSettings& settings, const QString& group)
+{
+    if (PendingTab::restoreTabs(settings, group, tabWidget_) == 0)
+        return false;
+    materializeTab(tabWidget_->currentIndex());
+    return true;
+}
+
 void CodeViewerWindow::setDarkMode(bool enabled)
 {
+    darkMode_ = enabled;
     QPalette pal = tabWidget_->palette();
 
     if (enabled) {
@@ -3,6 +3,8 @@
 #include <QTabWidget>
 #include "codeviewer.h"
 
+class QSettings;
+
 class CodeViewerWindow : public QMainWindow {
     Q_OBJECT
 public:
@@ -11,6 +13,23 @@ public:
     void openFile(const QString& path);
     void setDarkMode(bool enabled);
 
+    // Open tabs are saved under group; restoring adds them as placeholders
+    // (see PendingTab). Returns false when there was nothing to restore.
+    void saveSession(QSettings& settings, const QString& group) const;
+    bool restoreSession(QSettings& settings, const QString& group);
+
+    // The highlighting time budget is global; it is loaded once at startup
+    // and changed from either window.
+    static void loadHighlightingSettings();
+    static void editTimeBudget(QWidget* parent);
+    // Asks for a line (an offset for binary files) and moves viewer there;
+    // shared with the main window's editor dock.
+    static void promptGoToLine(CodeViewer* viewer, QWidget* parent);
+
 private:
     QTabWidget* tabWidget_;
+    bool darkMode_ = false;
+
+    CodeViewer* createViewer();
+    void materializeTab(int index);
 };
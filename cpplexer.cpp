@@ -0,0 +1,402 @@
+#include "cpplexer.h"
+
+#include <QChar>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+struct Keyword {
+    const char* word;
+    bool type;   // a name right after it is a variable
+};
+
+// Sorted by ASCII value for the binary search in findKeyword().
+const Keyword kKeywords[] = {
+    { "alignas", false },      { "alignof", false },     { "and", false },
+    { "and_eq", false },       { "asm", false },         { "auto", true },
+    { "bitand", false },       { "bitor", false },       { "bool", true },
+    { "break", false },        { "case", false },        { "catch", false },
+    { "char", true },          { "char16_t", true },     { "char32_t", true },
+    { "char8_t", true },       { "class", false },       { "co_await", false },
+    { "co_return", false },    { "co_yield", false },    { "compl", false },
+    { "concept", false },      { "const", false },       { "const_cast", false },
+    { "consteval", false },    { "constexpr", false },   { "constinit", false },
+    { "continue", false },     { "decltype", false },    { "default", false },
+    { "delete", false },       { "do", false },          { "double", true },
+    { "dynamic_cast", false }, { "else", false },        { "enum", false },
+    { "explicit", false },     { "export", false },      { "extern", false },
+    { "false", false },        { "final", false },       { "float", true },
+    { "for", false },          { "friend", false },      { "goto", false },
+    { "if", false },           { "inline", false },      { "int", true },
+    { "long", true },          { "mutable", false },     { "namespace", false },
+    { "new", false },          { "noexcept", false },    { "not", false },
+    { "not_eq", false },       { "nullptr", false },     { "operator", false },
+    { "or", false },           { "or_eq", false },       { "override", false },
+    { "private", false },      { "protected", false },   { "public", false },
+    { "register", false },     { "reinterpret_cast", false }, { "requires", false },
+    { "return", false },       { "short", true },        { "signed", true },
+    { "sizeof", false },       { "static", false },      { "static_assert", false },
+    { "static_cast", false },  { "struct", false },      { "switch", false },
+    { "template", false },     { "this", false },        { "thread_local", false },
+    { "throw", false },        { "true", false },        { "try", false },
+    { "typedef", false },      { "typeid", false },      { "typename", false },
+    { "union", false },        { "unsigned", true },     { "using", false },
+    { "virtual", false },      { "void", false },        { "volatile", false },
+    { "wchar_t", true },       { "while", false },       { "xor", false },
+    { "xor_eq", false },
+};
+constexpr int kLongestKeyword = 16;   // reinterpret_cast
+
+int compareAscii(QStringView word, const char* ascii)
+{
+    for (qsizetype i = 0;; ++i) {
+        const int a = i < word.size() ? word[i].unicode() : 0;
+        const int b = uchar(ascii[i]);
+        if (a != b || b == 0)
+            return a - b;
+    }
+}
+
+const Keyword* findKeyword(QStringView word)
+{
+    // Every keyword is lower case ASCII.
+    const char16_t first = word.utf16()[0];
+    if (word.size() > kLongestKeyword || first < u'a' || first > u'z')
+        return nullptr;
+
+    const auto it = std::lower_bound(std::begin(kKeywords), std::end(kKeywords), word,
+                                     [](const Keyword& k, QStringView w) {
+        return compareAscii(w, k.word) > 0;
+    });
+    return it != std::end(kKeywords) && compareAscii(word, it->word) == 0 ? it : nullptr;
+}
+
+inline bool isDigit(char16_t c)
+{
+    return char16_t(c - u'0') < 10;
+}
+
+inline bool isIdentStart(char16_t c)
+{
+    if (c < 0x80)
+        return char16_t((c | 0x20) - u'a') < 26 || c == u'_';
+    return QChar::isLetter(c);
+}
+
+inline bool isIdentChar(char16_t c)
+{
+    if (c < 0x80)
+        return char16_t((c | 0x20) - u'a') < 26 || isDigit(c) || c == u'_';
+    return QChar::isLetterOrNumber(c);
+}
+
+// Prefixes that turn a following quote into a literal: u8, u, U, L, and
+// for strings the same with R appended, or R alone.
+bool isLiteralPrefix(const char16_t* s, int length, bool string)
+{
+    if (string && s[length - 1] == u'R')
+        --length;
+    if (length == 0)
+        return string;
+    if (length == 1)
+        return s[0] == u'u' || s[0] == u'U' || s[0] == u'L';
+    return length == 2 && s[0] == u'u' && s[1] == u'8';
+}
+
+// The line ends in a backslash, so it is spliced to the next one.
+// Trailing blanks are allowed, as compilers do.
+inline bool isContinued(const char16_t* s, int n)
+{
+    while (n > 0 && (s[n - 1] == u' ' || s[n - 1] == u'\t'))
+        --n;
+    return n > 0 && s[n - 1] == u'\\';
+}
+
+// End of the literal closed by quote whose body starts at i, or -1 when
+// the line ends first.
+int closeQuoted(const char16_t* s, int n, int i, char16_t quote)
+{
+    for (int j = i; j < n; ++j) {
+        if (s[j] == u'\\')
+            ++j;
+        else if (s[j] == quote)
+            return j + 1;
+    }
+    return -1;
+}
+
+// Raw string delimiters are at most 16 characters; the state keeps their
+// length and a 16 bit hash rather than the text.
+constexpr int kMaxDelimiter = 16;
+constexpr int kDelimiterShift = 4;
+constexpr int kHashShift = 9;
+
+int delimiterHash(const char16_t* s, int length)
+{
+    quint32 hash = 2166136261u;
+    for (int k = 0; k < length; ++k)
+        hash = (hash ^ s[k]) * 16777619u;
+    return int((hash ^ (hash >> 16)) & 0xffff);
+}
+
+// Length of delim in the R"delim( whose quote is at i, or -1 if this is no
+// raw string opening.
+int rawDelimiterLength(const char16_t* s, int n, int i)
+{
+    for (int j = i + 1; j < n && j - i - 1 <= kMaxDelimiter; ++j) {
+        const char16_t c = s[j];
+        if (c == u'(')
+            return j - i - 1;
+        if (c == u' ' || c == u')' || c == u'\\' || c == u'\t' || c == u'"')
+            return -1;
+    }
+    return -1;
+}
+
+// End of the )delim" closing a raw string body that starts at i, or -1.
+int closeRawString(const char16_t* s, int n, int i, int length, int hash)
+{
+    for (int j = i; j + length + 1 < n; ++j) {
+        if (s[j] == u')' && s[j + length + 1] == u'"'
+            && delimiterHash(s + j + 1, length) == hash)
+            return j + length + 2;
+    }
+    return -1;
+}
+
+// End of the pp-number starting at i: digits, letters, '.', digit
+// separators and exponent signs, so 0x1p-3f and 1'000'000ull are one token.
+int scanNumber(const char16_t* s, int n, int i)
+{
+    int j = i + 1;
+    while (j < n) {
+        const char16_t c = s[j];
+        if ((c == u'+' || c == u'-')
+            && (s[j - 1] == u'e' || s[j - 1] == u'E' || s[j - 1] == u'p' || s[j - 1] == u'P'))
+            ++j;
+        else if (c == u'\'' && j + 1 < n && isIdentChar(s[j + 1]))
+            j += 2;
+        else if (isIdentChar(c) || c == u'.')
+            ++j;
+        else
+            break;
+    }
+    return j;
+}
+
+// Position just past the "*/" at or after i, or -1.
+int findCommentEnd(const char16_t* s, int n, int i)
+{
+    for (int j = i; j + 1 < n; ++j) {
+        if (s[j] == u'*' && s[j + 1] == u'/')
+            return j + 2;
+    }
+    return -1;
+}
+
+inline int skipBlanks(const char16_t* s, int n, int i)
+{
+    while (i < n && (s[i] == u' ' || s[i] == u'\t'))
+        ++i;
+    return i;
+}
+
+}
+
+bool CppLexer::isKeyword(QStringView word)
+{
+    return !word.isEmpty() && findKeyword(word) != nullptr;
+}
+
+int CppLexer::tokenize(QStringView line, int state, QVector<Token>& tokens)
+{
+    const char16_t* s = line.utf16();
+    const int n = int(line.size());
+    int i = 0;
+
+    auto add = [&tokens](int start, int end, TokenClass cls) {
+        if (end > start)
+            tokens.append({ start, end - start, cls });
+    };
+
+    // A directive goes on while its lines end in a backslash; so does
+    // anything left open in it.
+    bool directive = (state & kDirective) != 0;
+    auto leave = [&](int mode) {
+        return mode | (directive && (mode != Code || isContinued(s, n)) ? kDirective : 0);
+    };
+
+    // Finish what the previous line left open.
+    switch (state & kModeMask) {
+    case InComment: {
+        const int end = findCommentEnd(s, n, 0);
+        if (end < 0) {
+            add(0, n, TokenClass::Comment);
+            return state;
+        }
+        add(0, end, TokenClass::Comment);
+        i = end;
+        break;
+    }
+    case InLineComment:
+        add(0, n, TokenClass::Comment);
+        return isContinued(s, n) ? state : int(Code);
+    case InString:
+    case InChar: {
+        const int end = closeQuoted(s, n, 0, (state & kModeMask) == InString ? u'"' : u'\'');
+        if (end < 0) {
+            add(0, n, TokenClass::String);
+            return isContinued(s, n) ? state : int(Code);
+        }
+        add(0, end, TokenClass::String);
+        i = end;
+        break;
+    }
+    case InRawString: {
+        const int length = (state >> kDelimiterShift) & 0x1f;
+        const int end = closeRawString(s, n, 0, length, state >> kHashShift);
+        if (end < 0) {
+            add(0, n, TokenClass::String);
+            return state;
+        }
+        add(0, end, TokenClass::String);
+        i = end;
+        break;
+    }
+    default:
+        if (directive)
+            break;
+        // A '#' first on the line starts a directive; include and import
+        // take a <header> that is coloured like a string.
+        const int hash = skipBlanks(s, n, 0);
+        if (hash < n && s[hash] == u'#') {
+            directive = true;
+            const int name = skipBlanks(s, n, hash + 1);
+            int end = name;
+            while (end < n && isIdentChar(s[end]))
+                ++end;
+            add(hash, end, TokenClass::Preprocessor);
+            i = end;
+
+            const QStringView word = line.mid(name, end - name);
+            if (compareAscii(word, "include") == 0 || compareAscii(word, "import") == 0
+                || compareAscii(word, "include_next") == 0) {
+                const int open = skipBlanks(s, n, end);
+                if (open < n && s[open] == u'<') {
+                    int close = open + 1;
+                    while (close < n && s[close] != u'>')
+                        ++close;
+                    i = qMin(close + 1, n);
+                    add(open, i, TokenClass::String);
+                }
+            }
+        }
+        break;
+    }
+
+    int depth = 0;            // parentheses open on this line
+    bool afterType = false;   // the last name was a type keyword
+    while (i < n) {
+        const char16_t c = s[i];
+
+        if (c == u' ' || c == u'\t') {
+            ++i;
+            continue;
+        }
+
+        if (c == u'/' && i + 1 < n) {
+            if (s[i + 1] == u'/') {
+                add(i, n, TokenClass::Comment);
+                return isContinued(s, n) ? leave(InLineComment) : int(Code);
+            }
+            if (s[i + 1] == u'*') {
+                const int end = findCommentEnd(s, n, i + 2);
+                if (end < 0) {
+                    add(i, n, TokenClass::Comment);
+                    return leave(InComment);
+                }
+                add(i, end, TokenClass::Comment);
+                i = end;
+                continue;
+            }
+        }
+
+        if (c == u'"' || c == u'\'') {
+            const int end = closeQuoted(s, n, i + 1, c);
+            add(i, end < 0 ? n : end, TokenClass::String);
+            if (end < 0)
+                return isContinued(s, n) ? leave(c == u'"' ? InString : InChar) : int(Code);
+            i = end;
+            afterType = false;
+            continue;
+        }
+
+        if (isDigit(c) || (c == u'.' && i + 1 < n && isDigit(s[i + 1]))) {
+            const int end = scanNumber(s, n, i);
+            add(i, end, TokenClass::Number);
+            i = end;
+            afterType = false;
+            continue;
+        }
+
+        if (isIdentStart(c)) {
+            int end = i + 1;
+            while (end < n && isIdentChar(s[end]))
+                ++end;
+
+            // u8"...", LR"x(...)x", U'c' and friends.
+            if (end < n && (s[end] == u'"' || s[end] == u'\'')
+                && isLiteralPrefix(s + i, end - i, s[end] == u'"')) {
+                const int length = s[end] == u'"' && s[end - 1] == u'R'
+                    ? rawDelimiterLength(s, n, end) : -1;
+                if (length >= 0) {
+                    const int hash = delimiterHash(s + end + 1, length);
+                    const int close = closeRawString(s, n, end + length + 2, length, hash);
+                    add(i, close < 0 ? n : close, TokenClass::String);
+                    if (close < 0)
+                        return leave(InRawString | length << kDelimiterShift | hash << kHashShift);
+                    i = close;
+                } else {
+                    const int close = closeQuoted(s, n, end + 1, s[end]);
+                    add(i, close < 0 ? n : close, TokenClass::String);
+                    if (close < 0)
+                        return isContinued(s, n) ? leave(s[end] == u'"' ? InString : InChar) : int(Code);
+                    i = close;
+                }
+                afterType = false;
+                continue;
+            }
+
+            const QStringView word = line.mid(i, end - i);
+            const Keyword* keyword = findKeyword(word);
+            TokenClass cls = TokenClass::Normal;
+            if (keyword)
+                cls = TokenClass::Keyword;
+            else if (char16_t(c - u'A') < 26)
+                cls = TokenClass::Class;
+            else if (end < n && s[end] == u'(')
+                cls = TokenClass::Method;
+            else if (afterType)
+                cls = TokenClass::Variable;
+            else if (depth > 0)
+                cls = TokenClass::Parameter;
+
+            if (cls != TokenClass::Normal)
+                add(i, end, cls);
+            afterType = keyword ? keyword->type : compareAscii(word, "QString") == 0;
+            i = end;
+            continue;
+        }
+
+        if (c == u'(')
+            ++depth;
+        else if (c == u')' && depth > 0)
+            --depth;
+        // "int* p" and "const QString& name" still declare a variable.
+        if (c != u'*' && c != u'&')
+            afterType = false;
+        ++i;
+    }
+    return leave(Code);
+}
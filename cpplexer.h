@@ -0,0 +1,92 @@
+#pragma once
+#include <QStringView>
+#include <QVector>
+#include <QtGlobal>
+
+// What a piece of highlighted text is, independent of how it is drawn.
+enum class TokenClass : quint8 {
+    Normal,
+    Keyword,
+    Comment,
+    String,
+    Variable,
+    Method,
+    Class,
+    Number,
+    Preprocessor,
+    Parameter,
+};
+static constexpr int kTokenClassCount = int(TokenClass::Parameter) + 1;
+
+struct Token {
+    int start = 0;
+    int length = 0;
+    TokenClass cls = TokenClass::Normal;
+};
+
+// A line's tokens, viewed in memory owned elsewhere: a block's cached
+// tokens, or the scratch of codehighlighter::highlightLine(). Taking one
+// copies two words.
+struct TokenSpan {
+    const Token* data = nullptr;
+    int size = 0;
+
+    TokenSpan() = default;
+    TokenSpan(const Token* data, int size) : data(data), size(size) {}
+    TokenSpan(const QVector<Token>& tokens) : data(tokens.constData()), size(int(tokens.size())) {}
+
+    const Token* begin() const { return data; }
+    const Token* end() const { return data + size; }
+    bool isEmpty() const { return size == 0; }
+};
+
+// Calls fn(start, length, cls) for runs covering a line of lineLength
+// characters from start to end: the tokens, and the text between them as
+// Normal.
+template <typename Fn>
+void forEachRun(TokenSpan tokens, int lineLength, Fn&& fn)
+{
+    int pos = 0;
+    for (const Token& token : tokens) {
+        if (token.start > pos)
+            fn(pos, token.start - pos, TokenClass::Normal);
+        fn(token.start, token.length, token.cls);
+        pos = token.start + token.length;
+    }
+    if (pos < lineLength)
+        fn(pos, lineLength - pos, TokenClass::Normal);
+}
+
+// Hand-written C/C++ lexer: one left-to-right scan per line, no regular
+// expressions and no allocations beyond growing the caller's token vector.
+// Covers the C++23 keyword set, comments, string and character literals
+// with encoding prefixes and escapes, raw strings, pp-numbers and
+// preprocessor directives.
+class CppLexer {
+public:
+    // Block states, as stored by QSyntaxHighlighter: in the low bits, what
+    // the previous line left open. InRawString also keeps the length and a
+    // hash of the delimiter in the bits above kDirective, and kDirective is
+    // set while a directive goes on with backslash continuations, so a
+    // comment or string can be open inside a directive.
+    enum State {
+        Code = 0,
+        InComment = 1,       // inside /* */
+        InLineComment = 2,   // a // comment continued with a backslash
+        InString = 3,        // a "..." continued with a backslash
+        InChar = 4,          // a '...' continued with a backslash
+        InRawString = 5,     // inside R"delim( )delim"
+    };
+    static constexpr int kModeMask = 0x7;
+    static constexpr int kDirective = 0x8;
+
+    // Appends the tokens of one line to tokens, in order and without
+    // overlaps; text between them is Normal. state is the state at the
+    // start of the line (the previous line's result). Returns the state at
+    // its end, which only differs from what it was for the same text
+    // before an edit when the edit opened or closed something spanning
+    // lines, so QSyntaxHighlighter stops at the edited block.
+    static int tokenize(QStringView line, int state, QVector<Token>& tokens);
+
+    static bool isKeyword(QStringView word);
+};
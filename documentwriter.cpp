@@ -0,0 +1,99 @@
+#include "documentwriter.h"
+
+#include <QSaveFile>
+#include <QStringEncoder>
+
+namespace {
+constexpr qsizetype kWriteBufferBytes = 256 * 1024;
+// Spans are encoded in slices of this many characters at most.
+constexpr qsizetype kEncodeSliceChars = 64 * 1024;
+
+QStringConverter::Encoding converterEncoding(TextDecoder::Encoding encoding)
+{
+    switch (encoding) {
+    case TextDecoder::Utf16LE: return QStringConverter::Utf16LE;
+    case TextDecoder::Utf16BE: return QStringConverter::Utf16BE;
+    case TextDecoder::Latin1: return QStringConverter::Latin1;
+    case TextDecoder::Utf8: break;
+    }
+    return QStringConverter::Utf8;
+}
+}
+
+bool DocumentWriter::write(const TextSnapshot& text, const QString& path, const TextFormat& format,
+                           QString* error)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error)
+            *error = file.errorString();
+        return false;
+    }
+
+    QStringEncoder encoder(converterEncoding(format.encoding),
+                           format.bom ? QStringConverter::Flag::WriteBom : QStringConverter::Flag::Default);
+    QByteArray out;
+    out.reserve(kWriteBufferBytes + encoder.requiredSpace(kEncodeSliceChars));
+    bool ok = true;
+
+    auto flush = [&file, &out]() {
+        const bool written = file.write(out) == out.size();
+        out.resize(0);
+        return written;
+    };
+    auto encode = [&encoder, &out](QStringView piece) {
+        const qsizetype used = out.size();
+        out.resize(used + encoder.requiredSpace(piece.size()));
+        char* end = encoder.appendToBuffer(out.data() + used, piece);
+        out.resize(end - out.constData());
+    };
+
+    // The encoder keeps state, so a surrogate pair split between two
+    // pieces is still encoded correctly.
+    text.forEachSpan(0, text.length(), [&](QStringView span) {
+        while (ok && !span.isEmpty()) {
+            QStringView slice = span.first(qMin(span.size(), kEncodeSliceChars));
+            span = span.sliced(slice.size());
+
+            if (format.crlf) {
+                for (qsizetype lf; (lf = slice.indexOf(u'\n')) >= 0; slice = slice.sliced(lf + 1)) {
+                    encode(slice.first(lf));
+                    encode(u"\r\n");
+                }
+            }
+            encode(slice);
+
+            if (out.size() >= kWriteBufferBytes)
+                ok = flush();
+        }
+    });
+
+    ok = ok && flush();
+    if (ok && encoder.hasError()) {
+        if (error)
+            *error = QStringLiteral("The text contains characters that cannot be saved in the file's encoding.");
+        file.cancelWriting();
+        return false;
+    }
+    ok = ok && file.commit();
+
+    if (!ok) {
+        if (error)
+            *error = file.errorString();
+        file.cancelWriting();
+    }
+    return ok;
+}
+
+DocumentWriter::DocumentWriter(const QString& path, const TextSnapshot& text, const TextFormat& format,
+                               QObject* parent)
+    : QObject(parent), path_(path), text_(text), format_(format)
+{}
+
+void DocumentWriter::run()
+{
+    QString error;
+    const bool ok = write(text_, path_, format_, &error);
+    text_ = TextSnapshot();
+    emit finished(ok, error);
+}
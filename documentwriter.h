@@ -0,0 +1,35 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include "textbuffer.h"
+#include "textdecoder.h"
+
+// Saves documents through QSaveFile so a crash never leaves a truncated
+// file behind: the text goes to a temp file that is renamed over the
+// target on commit().
+class DocumentWriter : public QObject {
+    Q_OBJECT
+public:
+    // Encodes the snapshot span by span through a bounded buffer, in the
+    // format's encoding and line ending. Fails, leaving the file as it
+    // was, if the encoding cannot represent the text.
+    static bool write(const TextSnapshot& text, const QString& path, const TextFormat& format,
+                      QString* error = nullptr);
+
+    // Background writer. The snapshot is immutable, so the editor can keep
+    // changing while it is written. Move to a QThread and invoke run()
+    // from its started().
+    DocumentWriter(const QString& path, const TextSnapshot& text, const TextFormat& format,
+                   QObject* parent = nullptr);
+
+public slots:
+    void run();
+
+signals:
+    void finished(bool ok, const QString& error);
+
+private:
+    QString path_;
+    TextSnapshot text_;
+    TextFormat format_;
+};
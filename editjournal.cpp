@@ -0,0 +1,324 @@
+#include "editjournal.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QStandardPaths>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+// Edits are batched for this long before they are written and fsync'd.
+constexpr int kFlushIntervalMs = 300;
+
+constexpr quint8 kHeaderRecord = 'H';
+constexpr quint8 kEditRecord = 'E';
+
+// Record framing: payload size, checksum, payload. A torn write at the end
+// of the file fails the checksum and replay stops there.
+QByteArray frame(const QByteArray& payload)
+{
+    QByteArray out;
+    QDataStream s(&out, QIODevice::WriteOnly);
+    s << quint32(payload.size()) << quint16(qChecksum(payload));
+    s.writeRawData(payload.constData(), int(payload.size()));
+    return out;
+}
+
+QByteArray headerRecord(const QString& path)
+{
+    const QFileInfo info(path);
+    QByteArray payload;
+    QDataStream s(&payload, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_6_0);
+    s << kHeaderRecord << path << qint64(info.size())
+      << qint64(info.lastModified().toMSecsSinceEpoch());
+    return frame(payload);
+}
+
+QByteArray editRecord(const EditJournal::Operation& op)
+{
+    QByteArray payload;
+    QDataStream s(&payload, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_6_0);
+    s << kEditRecord << qint32(op.position) << qint32(op.removed) << op.added;
+    return frame(payload);
+}
+
+void syncToDisk(QFile& file)
+{
+    file.flush();
+#ifdef Q_OS_WIN
+    _commit(file.handle());
+#else
+    ::fsync(file.handle());
+#endif
+}
+}
+
+// Shared with the pool task that writes it, so a flush in flight outlives
+// the journal object if needed.
+struct EditJournal::Sink {
+    enum Kind { Append, Reset, Remove };
+    struct Command {
+        Kind kind;
+        QByteArray bytes;
+    };
+
+    QMutex mutex;
+    QWaitCondition idle;
+    QList<Command> queue;
+    bool busy = false;
+    QString fileName;
+    std::unique_ptr<QFile> file;   // only touched by the task holding busy
+
+    void drain();
+};
+
+void EditJournal::Sink::drain()
+{
+    for (;;) {
+        QList<Command> batch;
+        {
+            QMutexLocker lock(&mutex);
+            if (queue.isEmpty()) {
+                busy = false;
+                idle.wakeAll();
+                return;
+            }
+            batch.swap(queue);
+        }
+
+        for (const Command& c : std::as_const(batch)) {
+            switch (c.kind) {
+            case Reset:
+                file = std::make_unique<QFile>(fileName);
+                if (file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+                    file->write(c.bytes);
+                break;
+            case Append:
+                if (!file) {
+                    file = std::make_unique<QFile>(fileName);
+                    file->open(QIODevice::WriteOnly | QIODevice::Append);
+                }
+                if (file->isOpen())
+                    file->write(c.bytes);
+                break;
+            case Remove:
+                file.reset();
+                QFile::remove(fileName);
+                break;
+            }
+        }
+
+        if (file && file->isOpen())
+            syncToDisk(*file);
+    }
+}
+
+EditJournal::EditJournal(const QString& path, QObject* parent)
+    : QObject(parent), path_(path), sink_(std::make_shared<Sink>())
+{
+    QDir().mkpath(journalDir());
+    const QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+    sink_->fileName = journalDir() + "/" + QString::fromLatin1(key) + ".journal";
+
+    flushTimer_.setSingleShot(true);
+    flushTimer_.setInterval(kFlushIntervalMs);
+    connect(&flushTimer_, &QTimer::timeout, this, &EditJournal::scheduleFlush);
+}
+
+EditJournal::~EditJournal()
+{
+    flushTimer_.stop();
+    scheduleFlush();
+
+    QMutexLocker lock(&sink_->mutex);
+    while (sink_->busy)
+        sink_->idle.wait(&sink_->mutex);
+}
+
+QString EditJournal::journalDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/journal";
+}
+
+void EditJournal::start(const QVector<Operation>& applied)
+{
+    recording_ = true;
+    reset(applied);
+}
+
+void EditJournal::beginSave()
+{
+    saving_ = true;
+    sinceSave_.clear();
+}
+
+void EditJournal::endSave(bool ok)
+{
+    saving_ = false;
+    if (ok && recording_)
+        reset(sinceSave_);
+    sinceSave_.clear();
+}
+
+void EditJournal::discard()
+{
+    recording_ = false;
+    {
+        QMutexLocker lock(&sink_->mutex);
+        sink_->queue.append(Sink::Command{ Sink::Remove, QByteArray() });
+    }
+    scheduleFlush();
+}
+
+void EditJournal::record(int position, int removed, const QString& added)
+{
+    if (!recording_ || (removed == 0 && added.isEmpty()))
+        return;
+
+    append(Operation{ position, removed, added });
+}
+
+void EditJournal::append(const Operation& op)
+{
+    if (saving_)
+        sinceSave_.append(op);
+
+    {
+        QMutexLocker lock(&sink_->mutex);
+        sink_->queue.append(Sink::Command{ Sink::Append, editRecord(op) });
+    }
+
+    if (!flushTimer_.isActive())
+        flushTimer_.start();
+}
+
+void EditJournal::reset(const QVector<Operation>& operations)
+{
+    QByteArray bytes = headerRecord(path_);
+    for (const Operation& op : operations)
+        bytes += editRecord(op);
+
+    {
+        QMutexLocker lock(&sink_->mutex);
+        sink_->queue.append(Sink::Command{ Sink::Reset, bytes });
+    }
+    scheduleFlush();
+}
+
+void EditJournal::scheduleFlush()
+{
+    QMutexLocker lock(&sink_->mutex);
+    if (sink_->busy || sink_->queue.isEmpty())
+        return;
+
+    sink_->busy = true;
+    std::shared_ptr<Sink> sink = sink_;
+    QThreadPool::globalInstance()->start([sink]() { sink->drain(); });
+}
+
+QVector<EditJournal::Recovery> EditJournal::pendingRecoveries()
+{
+    QVector<Recovery> result;
+    const QDir dir(journalDir());
+
+    const QStringList files = dir.entryList({ "*.journal" }, QDir::Files);
+    for (const QString& name : files) {
+        const QString fileName = dir.absoluteFilePath(name);
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+
+        const QByteArray data = file.readAll();
+        file.close();
+
+        Recovery recovery;
+        recovery.journalFile = fileName;
+        bool haveHeader = false;
+
+        qsizetype pos = 0;
+        while (data.size() - pos >= 6) {
+            QDataStream fs(data.mid(pos, 6));
+            quint32 size;
+            quint16 checksum;
+            fs >> size >> checksum;
+
+            if (data.size() - pos - 6 < qsizetype(size))
+                break;
+            const QByteArray payload = data.mid(pos + 6, size);
+            if (qChecksum(payload) != checksum)
+                break;
+            pos += 6 + size;
+
+            QDataStream s(payload);
+            s.setVersion(QDataStream::Qt_6_0);
+            quint8 type;
+            s >> type;
+
+            if (type == kHeaderRecord) {
+                s >> recovery.path >> recovery.baseSize >> recovery.baseModified;
+                haveHeader = true;
+            } else if (type == kEditRecord && haveHeader) {
+                qint32 position, removed;
+                Operation op;
+                s >> position >> removed >> op.added;
+                op.position = position;
+                op.removed = removed;
+                recovery.operations.append(op);
+            }
+        }
+
+        // Journals without edits were left by clean sessions.
+        if (!haveHeader || recovery.operations.isEmpty()) {
+            QFile::remove(fileName);
+            continue;
+        }
+        result.append(recovery);
+    }
+    return result;
+}
+
+bool EditJournal::baseMatches(const Recovery& recovery)
+{
+    const QFileInfo info(recovery.path);
+    return info.exists()
+           && info.size() == recovery.baseSize
+           && info.lastModified().toMSecsSinceEpoch() == recovery.baseModified;
+}
+
+void EditJournal::removeJournal(const QString& journalFile)
+{
+    QFile::remove(journalFile);
+}
+
+void EditJournal::apply(QTextDocument* doc, const QVector<Operation>& operations)
+{
+    QTextCursor c(doc);
+    c.beginEditBlock();
+
+    for (const Operation& op : operations) {
+        const int length = doc->characterCount() - 1;
+        const int position = qBound(0, op.position, length);
+        const int removed = qBound(0, op.removed, length - position);
+
+        c.setPosition(position);
+        c.setPosition(position + removed, QTextCursor::KeepAnchor);
+        c.insertText(op.added);
+    }
+
+    c.endEditBlock();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QTimer>
+#include <memory>
+
+class QTextDocument;
+
+// Append-only log of the edits made to one open file, used to recover
+// unsaved work after a crash. Every text change SharedDocument reports
+// becomes a small record, so the cost follows the size of the edit, not of
+// the document. Records are written and fsync'd in batches on the global
+// thread pool. The journal is relative to the file on disk: a save starts
+// a new journal against the new contents.
+class EditJournal : public QObject {
+    Q_OBJECT
+public:
+    struct Operation {
+        int position = 0;
+        int removed = 0;
+        QString added;
+    };
+
+    struct Recovery {
+        QString journalFile;
+        QString path;
+        qint64 baseSize = 0;
+        qint64 baseModified = 0;   // ms since epoch
+        QVector<Operation> operations;
+    };
+
+    explicit EditJournal(const QString& path, QObject* parent = nullptr);
+    ~EditJournal() override;
+
+    // Starts recording against the current file on disk. Operations already
+    // applied to the document on top of that (a recovery) are written first.
+    void start(const QVector<Operation>& applied = {});
+
+    // One change to the text: removed characters at position replaced by
+    // added. SharedDocument calls this for real edits only; the format
+    // changes the highlighter makes never reach the journal.
+    void record(int position, int removed, const QString& added);
+
+    // Bracket a save: edits made while it runs are kept for the new journal.
+    void beginSave();
+    void endSave(bool ok);
+
+    // Drops the journal (the document matches the file on disk).
+    void discard();
+
+    static QString journalDir();
+    static QVector<Recovery> pendingRecoveries();
+    static bool baseMatches(const Recovery& recovery);
+    static void removeJournal(const QString& journalFile);
+    static void apply(QTextDocument* doc, const QVector<Operation>& operations);
+
+private:
+    struct Sink;
+
+    void append(const Operation& op);
+    void reset(const QVector<Operation>& operations);
+    void scheduleFlush();
+
+    QString path_;
+    std::shared_ptr<Sink> sink_;
+    QTimer flushTimer_;
+    bool recording_ = false;
+    bool saving_ = false;
+    QVector<Operation> sinceSave_;
+};
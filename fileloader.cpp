@@ -0,0 +1,97 @@
+#include "fileloader.h"
+#include "textdecoder.h"
+
+#include <QFile>
+
+namespace {
+// Small first chunk so the first screen appears right away, then larger
+// chunks to keep the number of document inserts down.
+constexpr qint64 kFirstChunkBytes = 64 * 1024;
+constexpr qint64 kChunkBytes = 1024 * 1024;
+}
+
+FileLoader::FileLoader(const QString& path, QObject* parent)
+    : QObject(parent), path_(path)
+{}
+
+bool FileLoader::emitChunk(const QString& text)
+{
+    credits_->acquire();
+    if (isCancelled())
+        return false;
+    emit chunkReady(text);
+    return true;
+}
+
+void FileLoader::run()
+{
+    QFile file(path_);
+    // Raw bytes: line endings are normalized after decoding so UTF-16
+    // files survive too.
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit finished(false);
+        return;
+    }
+
+    const qint64 total = file.size();
+    qint64 chunkSize = kFirstChunkBytes;
+
+    // Detects the encoding from the first chunk and carries multi-byte
+    // sequences split across chunks.
+    TextDecoder decoder;
+    bool heldCarriageReturn = false;
+    TextFormat format;
+    bool formatSent = false;
+
+    while (!file.atEnd()) {
+        if (isCancelled()) {
+            emit finished(false);
+            return;
+        }
+
+        const QByteArray bytes = file.read(chunkSize);
+        if (bytes.isEmpty())
+            break;
+
+        chunkSize = kChunkBytes;
+
+        QString text = decoder.feed(bytes);
+
+        // The first line break decides the line ending saves write.
+        if (!formatSent && (text.contains(QLatin1Char('\n')) || file.atEnd())) {
+            format.encoding = decoder.encoding();
+            format.bom = decoder.hadBom();
+            format.lossy = decoder.hadInvalidBytes();
+            const qsizetype lf = text.indexOf(QLatin1Char('\n'));
+            format.crlf = lf > 0 ? text.at(lf - 1) == QLatin1Char('\r')
+                                 : lf == 0 ? heldCarriageReturn : false;
+            emit formatDetected(format);
+            formatSent = true;
+        } else if (formatSent && !format.lossy && decoder.hadInvalidBytes()) {
+            // Invalid UTF-8 past the detection window.
+            format.lossy = true;
+            emit formatDetected(format);
+        }
+
+        // CRLF -> LF; a trailing CR waits for the next chunk.
+        if (heldCarriageReturn)
+            text.prepend(QLatin1Char('\r'));
+        heldCarriageReturn = text.endsWith(QLatin1Char('\r'));
+        if (heldCarriageReturn)
+            text.chop(1);
+        text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+
+        if (!text.isEmpty() && !emitChunk(text)) {
+            emit finished(false);
+            return;
+        }
+        emit progress(file.pos(), total);
+    }
+
+    if (heldCarriageReturn && !emitChunk(QStringLiteral("\n"))) {
+        emit finished(false);
+        return;
+    }
+
+    emit finished(!isCancelled());
+}
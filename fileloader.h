@@ -0,0 +1,52 @@
+#pragma once
+#include <QObject>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QString>
+#include <memory>
+#include "textdecoder.h"
+
+// Reads and decodes a text file on a worker thread and hands it to the
+// GUI in chunks, so the first screen can be shown before the whole file
+// has been read. Move to a QThread and invoke run() from its started().
+//
+// Only a few chunks are in flight at a time: the loader waits until the
+// receiver has released a credit for each chunk it has taken, so a fast
+// disk cannot queue the whole file in the GUI's event queue.
+class FileLoader : public QObject {
+    Q_OBJECT
+public:
+    explicit FileLoader(const QString& path, QObject* parent = nullptr);
+
+    static constexpr int kChunksInFlight = 2;
+
+    void cancel()
+    {
+        cancelled_.storeRelaxed(1);
+        credits_->release();   // wakes a loader waiting for one
+    }
+    bool isCancelled() const { return cancelled_.loadRelaxed() != 0; }
+
+    // Released once per chunkReady() when the chunk has been applied. Kept
+    // by the receiver, as it outlives the loader.
+    std::shared_ptr<QSemaphore> credits() const { return credits_; }
+
+public slots:
+    void run();
+
+signals:
+    // Sent before the chunk with the first line break (or the last chunk):
+    // the encoding and the line ending the file was read with. Sent again,
+    // with lossy set, if invalid UTF-8 turns up further on.
+    void formatDetected(const TextFormat& format);
+    void chunkReady(const QString& text);
+    void progress(qint64 bytesRead, qint64 totalBytes);
+    void finished(bool completed);
+
+private:
+    bool emitChunk(const QString& text);
+
+    QString path_;
+    QAtomicInt cancelled_;
+    std::shared_ptr<QSemaphore> credits_ = std::make_shared<QSemaphore>(kChunksInFlight);
+};
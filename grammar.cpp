@@ -0,0 +1,461 @@
+#include "grammar.h"
+
+#include <QChar>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct Definition {
+    QJsonObject json;
+    std::unique_ptr<const Grammar> grammar;   // compiled on first use
+};
+
+// Every definition under :/grammars, read once; compiled lazily.
+struct Registry {
+    std::vector<Definition> definitions;
+    QHash<QString, int> byExtension;   // lower case, without the dot
+};
+
+Registry& registry()
+{
+    static Registry registry = [] {
+        Registry r;
+        const QDir dir(QStringLiteral(":/grammars/grammars"));
+        for (const QString& file : dir.entryList({ QStringLiteral("*.json") }, QDir::Files, QDir::Name)) {
+            QFile f(dir.filePath(file));
+            if (!f.open(QIODevice::ReadOnly))
+                continue;
+            // A broken definition leaves its files unhighlighted.
+            const QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+            if (!doc.isObject())
+                continue;
+
+            const int index = int(r.definitions.size());
+            r.definitions.push_back({ doc.object(), nullptr });
+            for (const QJsonValue& ext : doc.object().value(QStringLiteral("extensions")).toArray())
+                r.byExtension.insert(ext.toString().toLower(), index);
+        }
+        return r;
+    }();
+    return registry;
+}
+
+// Strings or a single string, as definitions may give either.
+QStringList stringList(const QJsonValue& value)
+{
+    if (value.isString())
+        return { value.toString() };
+    QStringList list;
+    for (const QJsonValue& v : value.toArray())
+        list.append(v.toString());
+    return list;
+}
+
+TokenClass tokenClass(const QString& name)
+{
+    static const QHash<QString, TokenClass> classes = {
+        { QStringLiteral("keyword"), TokenClass::Keyword },
+        { QStringLiteral("comment"), TokenClass::Comment },
+        { QStringLiteral("string"), TokenClass::String },
+        { QStringLiteral("variable"), TokenClass::Variable },
+        { QStringLiteral("method"), TokenClass::Method },
+        { QStringLiteral("class"), TokenClass::Class },
+        { QStringLiteral("number"), TokenClass::Number },
+        { QStringLiteral("preprocessor"), TokenClass::Preprocessor },
+        { QStringLiteral("parameter"), TokenClass::Parameter },
+    };
+    return classes.value(name, TokenClass::String);
+}
+
+inline int skipBlanks(const char16_t* s, int n, int i)
+{
+    while (i < n && (s[i] == u' ' || s[i] == u'\t'))
+        ++i;
+    return i;
+}
+
+// A string that reaches a backslash at the end of the line goes on.
+inline bool isContinued(const char16_t* s, int n)
+{
+    return n > 0 && s[n - 1] == u'\\';
+}
+
+}
+
+Grammar::Grammar()
+{
+    std::fill(std::begin(firstOpener_), std::end(firstOpener_), qint16(-1));
+}
+
+const Grammar* Grammar::find(const QString& path)
+{
+    Registry& r = registry();
+    const auto it = r.byExtension.constFind(QFileInfo(path).suffix().toLower());
+    if (it == r.byExtension.constEnd())
+        return nullptr;
+
+    Definition& definition = r.definitions[*it];
+    if (definition.json.value(QStringLiteral("lexer")).toString() == QLatin1String("cpp"))
+        return cpp();
+    if (!definition.grammar)
+        definition.grammar = std::make_unique<const Grammar>(compile(definition.json));
+    return definition.grammar.get();
+}
+
+const Grammar* Grammar::forPath(const QString& path)
+{
+    const Grammar* grammar = find(path);
+    return grammar ? grammar : plainText();
+}
+
+const Grammar* Grammar::plainText()
+{
+    static const Grammar grammar = [] {
+        Grammar g;
+        g.name_ = QStringLiteral("Plain text");
+        return g;
+    }();
+    return &grammar;
+}
+
+const Grammar* Grammar::cpp()
+{
+    static const Grammar grammar = [] {
+        Grammar g;
+        g.name_ = QStringLiteral("C++");
+        g.cppLexer_ = true;
+        return g;
+    }();
+    return &grammar;
+}
+
+Grammar::Span Grammar::intern(const QString& text)
+{
+    const Span span{ int(chars_.size()), int(text.size()) };
+    chars_ += text;
+    return span;
+}
+
+Grammar Grammar::compile(const QJsonObject& definition)
+{
+    Grammar g;
+    g.name_ = definition.value(QStringLiteral("name")).toString();
+    g.classByCase_ = definition.value(QStringLiteral("classByCase")).toBool();
+    g.calls_ = definition.value(QStringLiteral("calls")).toBool();
+    g.parameters_ = definition.value(QStringLiteral("parameters")).toBool();
+    const QString separator = definition.value(QStringLiteral("keySeparator")).toString();
+    g.keySeparator_ = separator.isEmpty() ? 0 : separator.at(0).unicode();
+
+    // Character classes
+    for (char16_t c = 0; c < 128; ++c) {
+        quint8 flags = 0;
+        if (c == u' ' || c == u'\t')
+            flags |= kBlank;
+        if (QChar::isLetter(c) || c == u'_')
+            flags |= kIdentStart | kIdentChar;
+        if (c >= u'0' && c <= u'9')
+            flags |= kDigit | kIdentChar;
+        g.charFlags_[c] = flags;
+    }
+    for (const QChar c : definition.value(QStringLiteral("identChars")).toString()) {
+        if (c.unicode() < 128)
+            g.charFlags_[c.unicode()] |= kIdentStart | kIdentChar;
+    }
+
+    // Openers
+    const bool commentAtStart = definition.value(QStringLiteral("lineCommentAtStart")).toBool();
+    for (const QString& open : stringList(definition.value(QStringLiteral("lineComment"))))
+        g.openers_.append({ g.intern(open), OpenerKind::LineComment, commentAtStart, 0 });
+
+    const QStringList block = stringList(definition.value(QStringLiteral("blockComment")));
+    if (block.size() == 2) {
+        g.openers_.append({ g.intern(block[0]), OpenerKind::BlockComment, false, 0 });
+        g.blockClose_ = g.intern(block[1]);
+    }
+
+    for (const QJsonValue& value : definition.value(QStringLiteral("strings")).toArray()) {
+        const QJsonObject rule = value.toObject();
+        const QString open = rule.value(QStringLiteral("open")).toString();
+        if (open.isEmpty() || g.strings_.size() > 255)
+            continue;
+        g.openers_.append({ g.intern(open), OpenerKind::String,
+                            rule.value(QStringLiteral("lineStart")).toBool(),
+                            quint8(g.strings_.size()) });
+        g.strings_.append({ g.intern(rule.value(QStringLiteral("close")).toString(open)),
+                            tokenClass(rule.value(QStringLiteral("class")).toString()),
+                            rule.value(QStringLiteral("escapes")).toBool(true),
+                            rule.value(QStringLiteral("multiline")).toBool() });
+    }
+
+    for (const QString& open : stringList(definition.value(QStringLiteral("directive"))))
+        g.openers_.append({ g.intern(open), OpenerKind::Directive, false, 0 });
+
+    // Grouped by first character, longest first, so """ is tried before ".
+    g.openers_.erase(std::remove_if(g.openers_.begin(), g.openers_.end(),
+                                    [](const Opener& o) { return o.text.length == 0; }),
+                     g.openers_.end());
+    std::stable_sort(g.openers_.begin(), g.openers_.end(), [&g](const Opener& a, const Opener& b) {
+        const char16_t ca = g.chars_.at(a.text.offset).unicode();
+        const char16_t cb = g.chars_.at(b.text.offset).unicode();
+        return ca != cb ? ca < cb : a.text.length > b.text.length;
+    });
+    for (int i = int(g.openers_.size()) - 1; i >= 0; --i) {
+        const char16_t c = g.chars_.at(g.openers_[i].text.offset).unicode();
+        if (c < 128) {
+            g.firstOpener_[c] = qint16(i);
+            g.charFlags_[c] |= kOpener;
+        }
+    }
+
+    // Words
+    auto addWords = [&g](const QJsonValue& value, WordKind kind) {
+        for (const QString& word : stringList(value)) {
+            if (!word.isEmpty())
+                g.words_.append({ g.intern(word), kind });
+        }
+    };
+    addWords(definition.value(QStringLiteral("keywords")), WordKind::Keyword);
+    addWords(definition.value(QStringLiteral("types")), WordKind::Type);
+    addWords(definition.value(QStringLiteral("stringPrefixes")), WordKind::StringPrefix);
+    std::sort(g.words_.begin(), g.words_.end(), [&g](const Word& a, const Word& b) {
+        return g.view(a.text) < g.view(b.text);
+    });
+
+    g.chars_.squeeze();
+    g.openers_.squeeze();
+    g.strings_.squeeze();
+    g.words_.squeeze();
+    return g;
+}
+
+inline quint8 Grammar::flags(char16_t c) const
+{
+    if (c < 128)
+        return charFlags_[c];
+    return QChar::isLetter(c) ? quint8(kIdentStart | kIdentChar)
+        : QChar::isLetterOrNumber(c) ? quint8(kIdentChar) : quint8(0);
+}
+
+const Grammar::Opener* Grammar::matchOpener(const char16_t* s, int n, int i, bool lineStart) const
+{
+    const char16_t first = s[i];
+    for (int k = firstOpener_[first]; k < openers_.size(); ++k) {
+        const Opener& opener = openers_[k];
+        const QStringView text = view(opener.text);
+        if (text.front() != first)
+            break;
+        if (opener.lineStart && !lineStart)
+            continue;
+        if (i + text.size() <= n && text == QStringView(s + i, text.size()))
+            return &opener;
+    }
+    return nullptr;
+}
+
+int Grammar::closeString(const char16_t* s, int n, int i, const StringRule& rule) const
+{
+    const QStringView close = view(rule.close);
+    for (int j = i; j + close.size() <= n; ++j) {
+        if (rule.escapes && s[j] == u'\\')
+            ++j;
+        else if (s[j] == close.front() && close == QStringView(s + j, close.size()))
+            return j + int(close.size());
+    }
+    return -1;
+}
+
+const Grammar::Word* Grammar::findWord(QStringView word) const
+{
+    const auto it = std::lower_bound(words_.cbegin(), words_.cend(), word,
+                                     [this](const Word& w, QStringView key) {
+        return view(w.text) < key;
+    });
+    return it != words_.cend() && view(it->text) == word ? &*it : nullptr;
+}
+
+int Grammar::tokenize(QStringView line, int state, QVector<Token>& tokens) const
+{
+    if (cppLexer_)
+        return CppLexer::tokenize(line, state, tokens);
+
+    const char16_t* s = line.utf16();
+    const int n = int(line.size());
+    int i = 0;
+
+    auto add = [&tokens](int start, int end, TokenClass cls) {
+        if (end > start)
+            tokens.append({ start, end - start, cls });
+    };
+    // A name or string followed by the key separator is a key.
+    auto isKey = [&](int end) {
+        if (!keySeparator_)
+            return false;
+        const int next = skipBlanks(s, n, end);
+        return next < n && s[next] == keySeparator_;
+    };
+
+    // Whatever the previous line left open.
+    if (state == kInComment) {
+        const QStringView close = view(blockClose_);
+        const int end = close.isEmpty() ? -1 : int(line.indexOf(close));
+        if (end < 0) {
+            add(0, n, TokenClass::Comment);
+            return kInComment;
+        }
+        i = end + int(close.size());
+        add(0, i, TokenClass::Comment);
+    } else if (state >= kInString && state - kInString < strings_.size()) {
+        const StringRule& rule = strings_[state - kInString];
+        const int end = closeString(s, n, 0, rule);
+        if (end < 0) {
+            add(0, n, rule.cls);
+            return rule.multiline || (rule.escapes && isContinued(s, n)) ? state : kInitialState;
+        }
+        add(0, end, rule.cls);
+        i = end;
+    }
+    const int lineStart = i == 0 ? skipBlanks(s, n, 0) : -1;
+
+    int depth = 0;            // parentheses open on this line
+    bool afterType = false;   // the last name was a type
+    while (i < n) {
+        const char16_t c = s[i];
+        const quint8 f = flags(c);
+
+        if (f & kBlank) {
+            ++i;
+            continue;
+        }
+
+        if (f & kOpener) {
+            if (const Opener* opener = matchOpener(s, n, i, i == lineStart)) {
+                const int from = i;
+                i += opener->text.length;
+                switch (opener->kind) {
+                case OpenerKind::LineComment:
+                    add(from, n, TokenClass::Comment);
+                    return kInitialState;
+                case OpenerKind::BlockComment: {
+                    const int end = int(line.indexOf(view(blockClose_), i));
+                    if (end < 0) {
+                        add(from, n, TokenClass::Comment);
+                        return kInComment;
+                    }
+                    i = end + blockClose_.length;
+                    add(from, i, TokenClass::Comment);
+                    continue;
+                }
+                case OpenerKind::String: {
+                    const StringRule& rule = strings_[opener->rule];
+                    const int end = closeString(s, n, i, rule);
+                    if (end < 0) {
+                        add(from, n, rule.cls);
+                        // An unterminated single-line string ends with the
+                        // line, unless the line ends in a backslash.
+                        return rule.multiline || (rule.escapes && isContinued(s, n))
+                            ? kInString + opener->rule : kInitialState;
+                    }
+                    add(from, end, rule.cls == TokenClass::String && isKey(end)
+                        ? TokenClass::Variable : rule.cls);
+                    i = end;
+                    afterType = false;
+                    continue;
+                }
+                case OpenerKind::Directive: {
+                    int end = i;
+                    while (end < n && (flags(s[end]) & kIdentChar))
+                        ++end;
+                    if (end > i) {
+                        add(from, end, TokenClass::Preprocessor);
+                        i = end;
+                        continue;
+                    }
+                    i = from;   // a lone '@' is an operator
+                    break;
+                }
+                }
+            }
+        }
+
+        if ((f & kDigit) || (c == u'.' && i + 1 < n && (flags(s[i + 1]) & kDigit))) {
+            int end = i + 1;
+            while (end < n) {
+                const char16_t d = s[end];
+                if ((d == u'+' || d == u'-') && (s[end - 1] == u'e' || s[end - 1] == u'E'))
+                    ++end;
+                else if (d == u'.' || (flags(d) & kIdentChar))
+                    ++end;
+                else
+                    break;
+            }
+            add(i, end, TokenClass::Number);
+            i = end;
+            afterType = false;
+            continue;
+        }
+
+        if (f & kIdentStart) {
+            int end = i + 1;
+            while (end < n && (flags(s[end]) & kIdentChar))
+                ++end;
+
+            const Word* word = findWord(line.mid(i, end - i));
+
+            // r"...", f'...', b"""...""" and friends.
+            if (word && word->kind == WordKind::StringPrefix && end < n && (flags(s[end]) & kOpener)) {
+                const Opener* opener = matchOpener(s, n, end, false);
+                if (opener && opener->kind == OpenerKind::String) {
+                    const StringRule& rule = strings_[opener->rule];
+                    const int close = closeString(s, n, end + opener->text.length, rule);
+                    if (close < 0) {
+                        add(i, n, rule.cls);
+                        return rule.multiline || (rule.escapes && isContinued(s, n))
+                            ? kInString + opener->rule : kInitialState;
+                    }
+                    add(i, close, rule.cls);
+                    i = close;
+                    afterType = false;
+                    continue;
+                }
+            }
+
+            TokenClass cls = TokenClass::Normal;
+            if (word && word->kind != WordKind::StringPrefix)
+                cls = TokenClass::Keyword;
+            else if (isKey(end))
+                cls = TokenClass::Variable;
+            else if (classByCase_ && char16_t(c - u'A') < 26)
+                cls = TokenClass::Class;
+            else if (calls_ && end < n && s[end] == u'(')
+                cls = TokenClass::Method;
+            else if (afterType)
+                cls = TokenClass::Variable;
+            else if (parameters_ && depth > 0)
+                cls = TokenClass::Parameter;
+
+            if (cls != TokenClass::Normal)
+                add(i, end, cls);
+            afterType = word && word->kind == WordKind::Type;
+            i = end;
+            continue;
+        }
+
+        if (c == u'(')
+            ++depth;
+        else if (c == u')' && depth > 0)
+            --depth;
+        afterType = false;
+        ++i;
+    }
+    return kInitialState;
+}
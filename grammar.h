@@ -0,0 +1,105 @@
+#pragma once
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <QtGlobal>
+#include "cpplexer.h"
+
+class QJsonObject;
+
+// One language's lexical rules, compiled from a JSON definition under
+// :/grammars into flat tables: a flags byte and a first-opener index for
+// each of the first 128 code points, the comment, string and directive
+// openers grouped by first character, and the keywords sorted in a single
+// character buffer. The per-line scan only indexes these tables, so it
+// costs the same whatever the language or the number of languages.
+//
+// Each definition is compiled on first use and shared read-only by every
+// highlighter and worker thread. C/C++ keeps its hand-written lexer; its
+// definition only names it.
+class Grammar {
+public:
+    // Block state at the start of a document, for every grammar.
+    static constexpr int kInitialState = 0;
+
+    // The grammar claiming the file's extension, or null. GUI thread only.
+    static const Grammar* find(const QString& path);
+    // find(), or plainText() when no grammar claims the file.
+    static const Grammar* forPath(const QString& path);
+    // Produces no tokens.
+    static const Grammar* plainText();
+    static const Grammar* cpp();
+
+    QString name() const { return name_; }
+
+    // Same contract as CppLexer::tokenize().
+    int tokenize(QStringView line, int state, QVector<Token>& tokens) const;
+
+private:
+    // Block states: code, inside the block comment, or inside string rule
+    // state - kInString (multi-line, or continued with a backslash).
+    static constexpr int kInComment = CppLexer::InComment;
+    static constexpr int kInString = 2;
+
+    enum CharFlag : quint8 {
+        kBlank = 1,
+        kIdentStart = 2,
+        kIdentChar = 4,
+        kDigit = 8,
+        kOpener = 16,   // firstOpener_ has an entry
+    };
+
+    enum class OpenerKind : quint8 { LineComment, BlockComment, String, Directive };
+
+    enum class WordKind : quint8 { Keyword, Type, StringPrefix };
+
+    // Text in chars_ at [offset, offset + length).
+    struct Span {
+        int offset = 0;
+        int length = 0;
+    };
+
+    struct Opener {
+        Span text;
+        OpenerKind kind;
+        bool lineStart;   // only as the first thing on a line
+        quint8 rule;      // index into strings_ for String
+    };
+
+    struct StringRule {
+        Span close;
+        TokenClass cls;
+        bool escapes;     // a backslash escapes the next character
+        bool multiline;   // an unclosed string carries over to the next line
+    };
+
+    struct Word {
+        Span text;
+        WordKind kind;
+    };
+
+    Grammar();
+    static Grammar compile(const QJsonObject& definition);
+    Span intern(const QString& text);
+    QStringView view(Span span) const { return QStringView(chars_).mid(span.offset, span.length); }
+
+    quint8 flags(char16_t c) const;
+    const Opener* matchOpener(const char16_t* s, int n, int i, bool lineStart) const;
+    int closeString(const char16_t* s, int n, int i, const StringRule& rule) const;
+    const Word* findWord(QStringView word) const;
+
+    QString name_;
+    bool cppLexer_ = false;
+    bool classByCase_ = false;   // Capitalized names are classes
+    bool calls_ = false;         // a name followed by '(' is a method
+    bool parameters_ = false;    // names inside parentheses are parameters
+    char16_t keySeparator_ = 0;  // a name or string followed by it is a key
+
+    quint8 charFlags_[128] = {};
+    qint16 firstOpener_[128];
+    QVector<Opener> openers_;      // grouped by first character, longest first
+    QVector<StringRule> strings_;
+    QVector<Word> words_;          // sorted by text
+    Span blockClose_;
+    QString chars_;                // text of every span above
+};
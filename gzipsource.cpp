@@ -0,0 +1,337 @@
+#include "gzipsource.h"
+
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+
+#ifdef FILEEXPLORER_QT_ZLIB
+#include <QtZlib/zlib.h>
+#else
+#include <zlib.h>
+#endif
+
+namespace {
+constexpr int kWindowBytes = 32 * 1024;       // deflate history
+constexpr int kInputBytes = 64 * 1024;
+// A seek point every this many bytes of output bounds the work of a jump.
+constexpr qint64 kSpanBytes = 4 * 1024 * 1024;
+constexpr qint64 kChunkBytes = 256 * 1024;
+constexpr int kCachedChunks = 16;
+
+// Window bytes in stream order from a circular output buffer.
+QByteArray windowBefore(const uchar* window, uInt left, qint64 totalOut)
+{
+    QByteArray out;
+    out.reserve(kWindowBytes);
+    if (left)
+        out.append(reinterpret_cast<const char*>(window) + kWindowBytes - left, left);
+    if (left < uInt(kWindowBytes))
+        out.append(reinterpret_cast<const char*>(window), kWindowBytes - left);
+
+    // Early points have less history than a full window.
+    if (totalOut < kWindowBytes)
+        out = out.right(totalOut);
+    return out;
+}
+}
+
+// One inflate stream positioned somewhere in the output.
+struct GzipSource::Stream {
+    z_stream strm {};
+    bool active = false;
+    bool raw = false;       // started at a seek point: no header parsing
+    bool ended = false;
+    qint64 pos = 0;         // uncompressed offset of the next output byte
+    uchar input[kInputBytes];
+
+    ~Stream() { stop(); }
+
+    void stop()
+    {
+        if (active)
+            inflateEnd(&strm);
+        active = false;
+    }
+
+    bool start(QFile& file, const GzipIndex::Point& point)
+    {
+        stop();
+        strm = z_stream {};
+        if (inflateInit2(&strm, -15) != Z_OK)
+            return false;
+        active = true;
+        raw = true;
+        ended = false;
+
+        if (!file.seek(point.in - (point.bits ? 1 : 0)))
+            return false;
+        if (point.bits) {
+            char c;
+            if (!file.getChar(&c))
+                return false;
+            inflatePrime(&strm, point.bits, uchar(c) >> (8 - point.bits));
+        }
+
+        const QByteArray window = qUncompress(point.window);
+        if (!window.isEmpty())
+            inflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(window.constData()), uInt(window.size()));
+
+        pos = point.out;
+        return true;
+    }
+
+    // Fills dst with up to length bytes; fewer only at the end or on error.
+    qint64 read(QFile& file, uchar* dst, qint64 length, bool gzip)
+    {
+        strm.next_out = dst;
+        strm.avail_out = uInt(length);
+
+        while (strm.avail_out > 0 && !ended) {
+            if (strm.avail_in == 0) {
+                const qint64 n = file.read(reinterpret_cast<char*>(input), kInputBytes);
+                if (n <= 0) {
+                    ended = true;
+                    break;
+                }
+                strm.next_in = input;
+                strm.avail_in = uInt(n);
+            }
+
+            const int ret = inflate(&strm, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // Concatenated members: skip the trailer a raw stream left
+                // behind, then let zlib parse the next header itself.
+                if (raw && !skipTrailer(file, gzip ? 8 : 4)) {
+                    ended = true;
+                    break;
+                }
+                raw = false;
+                if (inflateReset2(&strm, 47) != Z_OK)
+                    ended = true;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                ended = true;
+            }
+        }
+
+        const qint64 produced = length - strm.avail_out;
+        pos += produced;
+        return produced;
+    }
+
+    bool skipTrailer(QFile& file, uInt bytes)
+    {
+        while (bytes > 0) {
+            if (strm.avail_in == 0) {
+                const qint64 n = file.read(reinterpret_cast<char*>(input), kInputBytes);
+                if (n <= 0)
+                    return false;
+                strm.next_in = input;
+                strm.avail_in = uInt(n);
+            }
+            const uInt n = qMin(bytes, strm.avail_in);
+            strm.next_in += n;
+            strm.avail_in -= n;
+            bytes -= n;
+        }
+        return true;
+    }
+};
+
+GzipSource::GzipSource(const QString& path, const GzipIndex& index)
+    : file_(path), index_(index), stream_(std::make_unique<Stream>())
+{}
+
+GzipSource::~GzipSource() = default;
+
+bool GzipSource::open()
+{
+    return index_.isValid() && file_.open(QIODevice::ReadOnly);
+}
+
+bool GzipSource::isCompressed(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray head = file.read(2);
+    if (head.size() < 2)
+        return false;
+
+    const uchar b0 = uchar(head[0]);
+    const uchar b1 = uchar(head[1]);
+    if (b0 == 0x1f && b1 == 0x8b)
+        return true;
+
+    // zlib headers are plausible text ("x^"), so also ask for the suffix.
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return (suffix == "zz" || suffix == "zlib")
+           && (b0 & 0x0f) == 8 && ((b0 << 8) | b1) % 31 == 0;
+}
+
+const QByteArray& GzipSource::chunk(qint64 number)
+{
+    for (int i = 0; i < cache_.size(); ++i) {
+        if (cache_[i].first == number) {
+            if (i > 0)
+                cache_.move(i, 0);
+            return cache_.first().second;
+        }
+    }
+
+    const qint64 start = number * kChunkBytes;
+    const qint64 length = qMin(kChunkBytes, index_.size - start);
+
+    // Continue the current stream if the chunk is just ahead of it.
+    Stream& s = *stream_;
+    if (!s.active || s.ended || s.pos > start || start - s.pos > kSpanBytes) {
+        const auto it = std::upper_bound(index_.points.cbegin(), index_.points.cend(), start,
+                                         [](qint64 offset, const GzipIndex::Point& p) { return offset < p.out; });
+        if (!s.start(file_, *(it - 1)))
+            s.stop();
+    }
+
+    QByteArray data(length, Qt::Uninitialized);
+    qint64 n = 0;
+
+    if (s.active) {
+        uchar discard[16 * 1024];
+        while (s.pos < start && !s.ended)
+            s.read(file_, discard, qMin<qint64>(sizeof(discard), start - s.pos), index_.gzip);
+        if (s.pos == start)
+            n = s.read(file_, reinterpret_cast<uchar*>(data.data()), length, index_.gzip);
+    }
+    if (n < length)
+        std::memset(data.data() + n, 0, length - n);
+
+    if (cache_.size() >= kCachedChunks)
+        cache_.removeLast();
+    cache_.prepend({ number, data });
+    return cache_.first().second;
+}
+
+QByteArrayView GzipSource::bytes(qint64 offset, qint64 length)
+{
+    offset = qBound<qint64>(0, offset, index_.size);
+    length = qBound<qint64>(0, length, index_.size - offset);
+    if (length == 0)
+        return QByteArrayView();
+
+    const qint64 first = offset / kChunkBytes;
+    const qint64 last = (offset + length - 1) / kChunkBytes;
+
+    if (first == last) {
+        const QByteArray& data = chunk(first);
+        return QByteArrayView(data.constData() + (offset - first * kChunkBytes), length);
+    }
+
+    scratch_.resize(length);
+    qint64 copied = 0;
+    for (qint64 n = first; n <= last; ++n) {
+        const QByteArray& data = chunk(n);
+        const qint64 from = qMax<qint64>(offset, n * kChunkBytes) - n * kChunkBytes;
+        const qint64 count = qMin<qint64>(data.size() - from, length - copied);
+        std::memcpy(scratch_.data() + copied, data.constData() + from, count);
+        copied += count;
+    }
+    return QByteArrayView(scratch_.constData(), length);
+}
+
+GzipIndexer::GzipIndexer(const QString& path, QObject* parent)
+    : QObject(parent), path_(path)
+{}
+
+void GzipIndexer::run()
+{
+    GzipIndex index;
+    LineIndex lines;
+
+    QFile file(path_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit finished(index, lines);
+        return;
+    }
+
+    const qint64 total = file.size();
+    const QByteArray head = file.peek(2);
+    index.gzip = head.size() == 2 && uchar(head[0]) == 0x1f && uchar(head[1]) == 0x8b;
+
+    z_stream strm {};
+    if (inflateInit2(&strm, 47) != Z_OK) {   // 32 + 15: gzip or zlib header
+        emit finished(index, lines);
+        return;
+    }
+
+    std::unique_ptr<uchar[]> input(new uchar[kInputBytes]);
+    std::unique_ptr<uchar[]> window(new uchar[kWindowBytes]);
+    qint64 totalIn = 0;
+    qint64 totalOut = 0;
+    qint64 last = 0;
+    bool done = false;
+
+    lines.append(nullptr, 0);
+    strm.avail_out = 0;
+
+    // Same loop as zran's build_index(): inflate block by block into a
+    // circular 32 KB window and add a point at block boundaries.
+    while (!done) {
+        if (isCancelled()) {
+            inflateEnd(&strm);
+            emit finished(GzipIndex(), LineIndex());
+            return;
+        }
+
+        const qint64 n = file.read(reinterpret_cast<char*>(input.get()), kInputBytes);
+        if (n <= 0)
+            break;   // truncated: keep what was decoded
+        strm.next_in = input.get();
+        strm.avail_in = uInt(n);
+
+        do {
+            if (strm.avail_out == 0) {
+                strm.avail_out = kWindowBytes;
+                strm.next_out = window.get();
+            }
+
+            uchar* outStart = strm.next_out;
+            totalIn += strm.avail_in;
+            totalOut += strm.avail_out;
+            const int ret = inflate(&strm, Z_BLOCK);
+            totalIn -= strm.avail_in;
+            totalOut -= strm.avail_out;
+
+            lines.append(outStart, strm.next_out - outStart);
+
+            if (ret == Z_STREAM_END) {
+                // Another member may follow; padding or junk ends the file.
+                if (strm.avail_in == 0 && file.atEnd()) {
+                    done = true;
+                    break;
+                }
+                inflateReset(&strm);
+                continue;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                done = true;   // damaged: keep what was decoded
+                break;
+            }
+
+            if ((strm.data_type & 128) && !(strm.data_type & 64)
+                && (totalOut == 0 || totalOut - last > kSpanBytes)) {
+                GzipIndex::Point point;
+                point.out = totalOut;
+                point.in = totalIn;
+                point.bits = strm.data_type & 7;
+                point.window = qCompress(windowBefore(window.get(), strm.avail_out, totalOut));
+                index.points.append(point);
+                last = totalOut;
+            }
+        } while (strm.avail_in != 0);
+
+        emit progress(totalIn, total);
+    }
+
+    inflateEnd(&strm);
+    index.size = totalOut;
+    emit finished(index, lines);
+}
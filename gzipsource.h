@@ -0,0 +1,83 @@
+#pragma once
+#include "bytesource.h"
+#include "lineindex.h"
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QVector>
+#include <memory>
+
+// Seek points into a gzip or zlib stream, in the style of zlib's zran
+// example: every few MB of output, the compressed position (down to the
+// bit) and the 32 KB of output before it are kept, so decompression can
+// restart there instead of at the beginning of the file.
+struct GzipIndex {
+    struct Point {
+        qint64 out = 0;      // uncompressed offset
+        qint64 in = 0;       // compressed offset of the next whole byte
+        int bits = 0;        // bits of the byte before `in` not used yet
+        QByteArray window;   // preceding output (up to 32 KB), qCompress'd
+    };
+
+    QVector<Point> points;
+    qint64 size = 0;         // uncompressed bytes that could be read
+    bool gzip = true;        // gzip (8 byte trailer) or zlib (4 byte trailer)
+
+    bool isValid() const { return !points.isEmpty(); }
+};
+
+// Decompressed view of a gzip/zlib file. Output is produced in fixed-size
+// chunks, a few of which are cached, so memory stays bounded whatever
+// the uncompressed size. Reading on from the last chunk continues the
+// current stream; jumping elsewhere restarts at the nearest seek point.
+class GzipSource : public ByteSource {
+public:
+    GzipSource(const QString& path, const GzipIndex& index);
+    ~GzipSource() override;
+
+    bool open();
+
+    qint64 size() const override { return index_.size; }
+    QByteArrayView bytes(qint64 offset, qint64 length) override;
+
+    // gzip magic, or a zlib header on a .zz / .zlib file.
+    static bool isCompressed(const QString& path);
+
+private:
+    struct Stream;
+
+    const QByteArray& chunk(qint64 number);
+
+    QFile file_;
+    GzipIndex index_;
+    std::unique_ptr<Stream> stream_;
+    QList<QPair<qint64, QByteArray>> cache_;   // most recently used first
+    QByteArray scratch_;                       // ranges spanning two chunks
+};
+
+// Decompresses a whole file once on a worker thread, recording seek
+// points and a LineIndex of the output on the way. A stream that is
+// truncated or damaged is indexed up to the damage. Move to a QThread
+// and invoke run() from its started().
+class GzipIndexer : public QObject {
+    Q_OBJECT
+public:
+    explicit GzipIndexer(const QString& path, QObject* parent = nullptr);
+
+    void cancel() { cancelled_.storeRelaxed(1); }
+    bool isCancelled() const { return cancelled_.loadRelaxed() != 0; }
+
+public slots:
+    void run();
+
+signals:
+    void progress(qint64 compressedDone, qint64 compressedTotal);
+    void finished(const GzipIndex& index, const LineIndex& lines);
+
+private:
+    QString path_;
+    QAtomicInt cancelled_;
+};
@@ -0,0 +1,433 @@
+#include "hexview.h"
+
+#include <QPainter>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QThread>
+
+namespace {
+constexpr qint64 kPageBytes = 4096;
+constexpr int kCachedPages = 64;
+// The search maps this much of the file at a time.
+constexpr qint64 kSearchWindow = 4 * 1024 * 1024;
+// Keep the scrollbar range well inside int.
+constexpr qint64 kMaxScrollRange = 1 << 30;
+constexpr int kMargin = 4;
+
+// Columns, in character cells: offset, gap, hex bytes (with an extra gap
+// after the eighth), gap, ASCII.
+int hexColumn(int digits) { return digits + 2; }
+int byteColumn(int i) { return i * 3 + (i >= 8 ? 1 : 0); }
+int asciiColumn(int digits) { return hexColumn(digits) + HexView::kBytesPerRow * 3 + 2; }
+}
+
+HexSearcher::HexSearcher(const QString& path, const QByteArray& pattern, qint64 from,
+                         bool backward, QObject* parent)
+    : QObject(parent), path_(path), pattern_(pattern), from_(from), backward_(backward)
+{}
+
+void HexSearcher::run()
+{
+    QFile file(path_);
+    const qint64 n = pattern_.size();
+    if (n == 0 || !file.open(QIODevice::ReadOnly)) {
+        emit finished(-1);
+        return;
+    }
+
+    const qint64 size = file.size();
+    const qint64 window = qMax(kSearchWindow, 2 * n);
+
+    // Windows overlap by n - 1 bytes so matches across a seam are found.
+    if (!backward_) {
+        for (qint64 pos = qMax<qint64>(0, from_); size - pos >= n && !isCancelled();) {
+            const qint64 length = qMin(window, size - pos);
+            const uchar* data = file.map(pos, length);
+            if (!data)
+                break;
+            const qsizetype hit = QByteArrayView(data, length).indexOf(pattern_);
+            file.unmap(const_cast<uchar*>(data));
+            if (hit >= 0) {
+                emit finished(pos + hit);
+                return;
+            }
+            pos += length - (n - 1);
+        }
+    } else {
+        for (qint64 end = qMin(size, from_ + n - 1); end >= n && !isCancelled();) {
+            const qint64 start = qMax<qint64>(0, end - window);
+            const uchar* data = file.map(start, end - start);
+            if (!data)
+                break;
+            const qsizetype hit = QByteArrayView(data, end - start).lastIndexOf(pattern_);
+            file.unmap(const_cast<uchar*>(data));
+            if (hit >= 0) {
+                emit finished(start + hit);
+                return;
+            }
+            if (start == 0)
+                break;
+            end = start + n - 1;
+        }
+    }
+    emit finished(-1);
+}
+
+HexView::HexView(QWidget* parent)
+    : QAbstractScrollArea(parent)
+{
+    QFont font("Consolas", 11);
+    font.setStyleHint(QFont::Monospace);
+    setFont(font);
+    setFocusPolicy(Qt::StrongFocus);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    viewport()->setAutoFillBackground(true);
+    setDarkMode(false);
+}
+
+HexView::~HexView()
+{
+    closeFile();
+}
+
+bool HexView::openFile(const QString& path)
+{
+    closeFile();
+
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::ReadOnly))
+        return false;
+
+    size_ = file_.size();
+    topRow_ = 0;
+    cursor_ = -1;
+    updateScrollBars();
+    viewport()->update();
+    return true;
+}
+
+void HexView::closeFile()
+{
+    stopSearch();
+    unmapPages();
+    if (file_.isOpen())
+        file_.close();
+    size_ = 0;
+    topRow_ = 0;
+    cursor_ = -1;
+}
+
+const uchar* HexView::page(qint64 index)
+{
+    for (int i = 0; i < pages_.size(); ++i) {
+        if (pages_[i].index == index) {
+            if (i > 0)
+                pages_.move(i, 0);
+            return pages_.first().data;
+        }
+    }
+
+    const qint64 offset = index * kPageBytes;
+    const uchar* data = file_.map(offset, qMin(kPageBytes, size_ - offset));
+    if (!data)
+        return nullptr;
+
+    if (pages_.size() >= kCachedPages) {
+        file_.unmap(const_cast<uchar*>(pages_.last().data));
+        pages_.removeLast();
+    }
+    pages_.prepend({ index, data });
+    return data;
+}
+
+void HexView::unmapPages()
+{
+    for (const Page& p : std::as_const(pages_))
+        file_.unmap(const_cast<uchar*>(p.data));
+    pages_.clear();
+}
+
+void HexView::setDarkMode(bool enabled)
+{
+    QPalette p = palette();
+
+    if (enabled) {
+        p.setColor(QPalette::Base, QColor(42,42,42));
+        p.setColor(QPalette::Text, Qt::white);
+        p.setColor(QPalette::PlaceholderText, QColor(140,140,140));
+        p.setColor(QPalette::Highlight, QColor(140,140,140).lighter());
+        p.setColor(QPalette::HighlightedText, Qt::black);
+    } else {
+        p.setColor(QPalette::Base, QColor(255,255,255));
+        p.setColor(QPalette::Text, QColor(30,30,30));
+        p.setColor(QPalette::PlaceholderText, QColor(120,120,120));
+        p.setColor(QPalette::Highlight, QColor(100,150,255));
+        p.setColor(QPalette::HighlightedText, Qt::white);
+    }
+
+    setPalette(p);
+    viewport()->setPalette(p);
+    viewport()->update();
+}
+
+int HexView::visibleRowCount() const
+{
+    const int lineHeight = fontMetrics().height();
+    return lineHeight > 0 ? viewport()->height() / lineHeight : 0;
+}
+
+void HexView::setTopRow(qint64 row)
+{
+    const qint64 last = qMax<qint64>(0, rowCount() - visibleRowCount());
+    topRow_ = qBound<qint64>(0, row, last);
+    syncScrollBar();
+    viewport()->update();
+}
+
+void HexView::goToOffset(qint64 offset)
+{
+    if (size_ == 0)
+        return;
+
+    cursor_ = qBound<qint64>(0, offset, size_ - 1);
+    selectionLength_ = 1;
+
+    const qint64 row = cursor_ / kBytesPerRow;
+    const int rows = visibleRowCount();
+    if (row < topRow_ || row >= topRow_ + rows)
+        setTopRow(row - rows / 2);
+    else
+        viewport()->update();
+}
+
+void HexView::findNext(const QByteArray& pattern)
+{
+    startSearch(pattern, cursor_ < 0 ? 0 : cursor_ + 1, false);
+}
+
+void HexView::findPrevious(const QByteArray& pattern)
+{
+    startSearch(pattern, cursor_ < 0 ? size_ : cursor_, true);
+}
+
+void HexView::startSearch(const QByteArray& pattern, qint64 from, bool backward)
+{
+    stopSearch();
+    if (pattern.isEmpty() || !file_.isOpen())
+        return;
+
+    auto* thread = new QThread;
+    auto* searcher = new HexSearcher(file_.fileName(), pattern, from, backward);
+    searcher->moveToThread(thread);
+
+    connect(thread, &QThread::started, searcher, &HexSearcher::run);
+    connect(searcher, &HexSearcher::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, searcher, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    // A cancelled search may still deliver its result; the id drops it.
+    const int id = ++searchId_;
+    const int length = int(pattern.size());
+    connect(searcher, &HexSearcher::finished, this, [this, id, length](qint64 offset) {
+        if (id != searchId_)
+            return;
+        searcher_ = nullptr;
+        searchThread_ = nullptr;
+
+        if (offset >= 0) {
+            goToOffset(offset);
+            selectionLength_ = length;
+            viewport()->update();
+        }
+        emit searchFinished(offset >= 0);
+    });
+
+    searcher_ = searcher;
+    searchThread_ = thread;
+    thread->start();
+}
+
+void HexView::stopSearch()
+{
+    if (!searchThread_)
+        return;
+
+    if (searcher_)
+        searcher_->cancel();
+
+    searchThread_->quit();
+    searchThread_->wait();
+    ++searchId_;
+
+    searcher_ = nullptr;
+    searchThread_ = nullptr;
+}
+
+void HexView::updateScrollBars()
+{
+    const qint64 last = qMax<qint64>(0, rowCount() - visibleRowCount());
+
+    shift_ = 0;
+    while ((last >> shift_) > kMaxScrollRange)
+        ++shift_;
+
+    const int cell = fontMetrics().horizontalAdvance('0');
+    const int width = 2 * kMargin + (asciiColumn(offsetDigits()) + kBytesPerRow) * cell;
+
+    syncing_ = true;
+    QScrollBar* vsb = verticalScrollBar();
+    vsb->setRange(0, int(last >> shift_));
+    vsb->setPageStep(qMax(1, visibleRowCount() >> shift_));
+    vsb->setValue(int(topRow_ >> shift_));
+
+    QScrollBar* hsb = horizontalScrollBar();
+    hsb->setRange(0, qMax(0, width - viewport()->width()));
+    hsb->setPageStep(viewport()->width());
+    hsb->setSingleStep(cell * 4);
+    syncing_ = false;
+}
+
+void HexView::syncScrollBar()
+{
+    syncing_ = true;
+    verticalScrollBar()->setValue(int(topRow_ >> shift_));
+    syncing_ = false;
+}
+
+void HexView::scrollContentsBy(int, int dy)
+{
+    if (dy != 0 && !syncing_)
+        topRow_ = qint64(verticalScrollBar()->value()) << shift_;
+
+    viewport()->update();
+}
+
+void HexView::wheelEvent(QWheelEvent* event)
+{
+    const int steps = event->angleDelta().y() / 120;
+    if (steps != 0) {
+        setTopRow(topRow_ - steps * 3);
+        event->accept();
+        return;
+    }
+    QAbstractScrollArea::wheelEvent(event);
+}
+
+void HexView::keyPressEvent(QKeyEvent* event)
+{
+    const int page = qMax(1, visibleRowCount() - 1);
+
+    switch (event->key()) {
+    case Qt::Key_Up:       setTopRow(topRow_ - 1); break;
+    case Qt::Key_Down:     setTopRow(topRow_ + 1); break;
+    case Qt::Key_PageUp:   setTopRow(topRow_ - page); break;
+    case Qt::Key_PageDown: setTopRow(topRow_ + page); break;
+    case Qt::Key_Home:     setTopRow(0); break;
+    case Qt::Key_End:      setTopRow(rowCount()); break;
+    case Qt::Key_Left:     goToOffset(cursor_ - 1); break;
+    case Qt::Key_Right:    goToOffset(cursor_ + 1); break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+    event->accept();
+}
+
+void HexView::mousePressEvent(QMouseEvent* event)
+{
+    const QFontMetrics fm = fontMetrics();
+    const int cell = fm.horizontalAdvance('0');
+    const int digits = offsetDigits();
+    const int x = event->position().toPoint().x() - kMargin + horizontalScrollBar()->value();
+    const qint64 row = topRow_ + event->position().toPoint().y() / fm.height();
+    const int column = cell > 0 ? x / cell : 0;
+
+    // A click on either the hex or the ASCII form selects the byte.
+    int byte = -1;
+    if (column >= asciiColumn(digits)) {
+        byte = column - asciiColumn(digits);
+    } else if (column >= hexColumn(digits)) {
+        const int c = column - hexColumn(digits);
+        byte = c >= byteColumn(8) ? (c - 1) / 3 : c / 3;
+    }
+
+    if (byte >= 0 && byte < kBytesPerRow) {
+        const qint64 offset = row * kBytesPerRow + byte;
+        if (offset < size_) {
+            cursor_ = offset;
+            selectionLength_ = 1;
+            viewport()->update();
+        }
+    }
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void HexView::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void HexView::paintEvent(QPaintEvent*)
+{
+    QPainter p(viewport());
+    const QPalette pal = palette();
+    p.fillRect(viewport()->rect(), pal.color(QPalette::Base));
+
+    if (!file_.isOpen() || size_ == 0)
+        return;
+
+    p.setFont(font());
+
+    const QFontMetrics fm = fontMetrics();
+    const int lineHeight = fm.height();
+    const int cell = fm.horizontalAdvance('0');
+    const int digits = offsetDigits();
+    const int x0 = kMargin - horizontalScrollBar()->value();
+    const int hexX = x0 + hexColumn(digits) * cell;
+    const int asciiX = x0 + asciiColumn(digits) * cell;
+    const qint64 selectionEnd = cursor_ + selectionLength_;
+
+    static const char hexDigits[] = "0123456789ABCDEF";
+    QString hex(kBytesPerRow * 3 + 1, QLatin1Char(' '));
+    QString ascii(kBytesPerRow, QLatin1Char(' '));
+
+    for (qint64 row = topRow_; row < rowCount(); ++row) {
+        const int y = int(row - topRow_) * lineHeight;
+        if (y >= viewport()->height())
+            break;
+
+        const qint64 start = row * kBytesPerRow;
+        const int count = int(qMin<qint64>(kBytesPerRow, size_ - start));
+
+        p.setPen(pal.color(QPalette::PlaceholderText));
+        p.drawText(x0, y + fm.ascent(), QString("%1").arg(start, digits, 16, QLatin1Char('0')).toUpper());
+
+        // Rows never cross a page: 16 divides 4096.
+        const uchar* data = page(start / kPageBytes);
+        if (!data)
+            continue;
+        data += start % kPageBytes;
+
+        hex.fill(QLatin1Char(' '));
+        ascii.fill(QLatin1Char(' '));
+        for (int i = 0; i < count; ++i) {
+            const uchar b = data[i];
+            hex[byteColumn(i)] = QLatin1Char(hexDigits[b >> 4]);
+            hex[byteColumn(i) + 1] = QLatin1Char(hexDigits[b & 0xf]);
+            ascii[i] = b >= 0x20 && b < 0x7f ? QLatin1Char(char(b)) : QLatin1Char('.');
+
+            if (start + i >= cursor_ && start + i < selectionEnd) {
+                p.fillRect(hexX + byteColumn(i) * cell, y, 2 * cell, lineHeight, pal.color(QPalette::Highlight));
+                p.fillRect(asciiX + i * cell, y, cell, lineHeight, pal.color(QPalette::Highlight));
+            }
+        }
+
+        p.setPen(pal.color(QPalette::Text));
+        p.drawText(hexX, y + fm.ascent(), hex);
+        p.drawText(asciiX, y + fm.ascent(), ascii);
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <QAbstractScrollArea>
+#include <QAtomicInt>
+#include <QFile>
+#include <QList>
+#include <QPointer>
+
+class QThread;
+
+// Byte pattern search over a file on a worker thread. The file is mapped
+// in windows of a few MB, so the search never holds more than that.
+// Move to a QThread and invoke run() from its started().
+class HexSearcher : public QObject {
+    Q_OBJECT
+public:
+    // Finds the first match at or after from, or with backward the last
+    // match starting before from.
+    HexSearcher(const QString& path, const QByteArray& pattern, qint64 from,
+                bool backward, QObject* parent = nullptr);
+
+    void cancel() { cancelled_.storeRelaxed(1); }
+    bool isCancelled() const { return cancelled_.loadRelaxed() != 0; }
+
+public slots:
+    void run();
+
+signals:
+    // offset is -1 when there is no match (or the search was cancelled).
+    void finished(qint64 offset);
+
+private:
+    QString path_;
+    QByteArray pattern_;
+    qint64 from_;
+    bool backward_;
+    QAtomicInt cancelled_;
+};
+
+// Read-only hex dump for binary files: offset, 16 bytes in hex and their
+// ASCII form per row. The file is mapped one 4 KB page at a time as rows
+// scroll into view and only a few pages stay mapped, so opening, painting
+// and jumping cost the same whatever the file size.
+class HexView : public QAbstractScrollArea {
+    Q_OBJECT
+public:
+    static constexpr int kBytesPerRow = 16;
+
+    explicit HexView(QWidget* parent = nullptr);
+    ~HexView() override;
+
+    bool openFile(const QString& path);
+    void closeFile();
+    qint64 fileSize() const { return size_; }
+    QString filePath() const { return file_.fileName(); }
+
+    void setDarkMode(bool enabled);
+
+    // Selects the byte at offset and scrolls it into view.
+    void goToOffset(qint64 offset);
+    qint64 currentOffset() const { return cursor_; }
+
+    // Searches from the byte after (or before) the selection. The result
+    // is selected once found; searchFinished() reports it either way.
+    void findNext(const QByteArray& pattern);
+    void findPrevious(const QByteArray& pattern);
+    bool isSearching() const { return searchThread_ != nullptr; }
+
+signals:
+    void searchFinished(bool found);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+
+private:
+    struct Page {
+        qint64 index;
+        const uchar* data;
+    };
+
+    const uchar* page(qint64 index);
+    void unmapPages();
+    qint64 rowCount() const { return (size_ + kBytesPerRow - 1) / kBytesPerRow; }
+    int visibleRowCount() const;
+    int offsetDigits() const { return size_ > 0xffffffffLL ? 16 : 8; }
+    void setTopRow(qint64 row);
+    void updateScrollBars();
+    void syncScrollBar();
+    void startSearch(const QByteArray& pattern, qint64 from, bool backward);
+    void stopSearch();
+
+    QFile file_;
+    qint64 size_ = 0;
+    QList<Page> pages_;     // most recently used first
+
+    qint64 topRow_ = 0;
+    int shift_ = 0;         // row >> shift_ == scrollbar value
+    bool syncing_ = false;
+    qint64 cursor_ = -1;    // selected byte
+    int selectionLength_ = 1;
+
+    QPointer<HexSearcher> searcher_;
+    QPointer<QThread> searchThread_;
+    int searchId_ = 0;
+};
@@ -0,0 +1,214 @@
+#include "highlightcache.h"
+
+#include <QByteArrayView>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <algorithm>
+
+namespace {
+
+constexpr quint32 kMagic = 0x46454843;   // "FEHC"
+constexpr quint16 kVersion = 1;
+
+// Total size of the directory; least recently used entries are removed
+// beyond it.
+constexpr qint64 kMaxCacheBytes = 64 * 1024 * 1024;
+
+QString entryFile(const QString& path)
+{
+    const QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return HighlightCache::cacheDir() + "/" + QString::fromLatin1(key) + ".tokens";
+}
+
+qint64 modifiedTime(const QFileInfo& info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+void putVarint(QByteArray& out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+bool getVarint(const uchar*& p, const uchar* end, quint32* value)
+{
+    quint32 result = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        const uchar byte = *p++;
+        result |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray encode(const LexedLines& lines)
+{
+    QByteArray out;
+    out.reserve(lines.lineCount() * 2 + lines.tokens.size() * 3);
+    int token = 0;
+    for (int line = 0; line < lines.lineCount(); ++line) {
+        const int end = lines.tokenEnds[line];
+        putVarint(out, quint32(lines.states[line]));
+        putVarint(out, quint32(end - token));
+        int pos = 0;
+        for (; token < end; ++token) {
+            const Token& t = lines.tokens[token];
+            putVarint(out, quint32(t.start - pos));
+            putVarint(out, quint32(t.length));
+            out.append(char(t.cls));
+            pos = t.start + t.length;
+        }
+    }
+    return out;
+}
+
+bool decode(const QByteArray& data, int lineCount, int tokenCount, LexedLines* lines)
+{
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    const uchar* end = p + data.size();
+
+    lines->states.reserve(lineCount);
+    lines->tokenEnds.reserve(lineCount);
+    lines->tokens.reserve(tokenCount);
+    for (int line = 0; line < lineCount; ++line) {
+        quint32 state, count;
+        if (!getVarint(p, end, &state) || !getVarint(p, end, &count) || int(state) < 0)
+            return false;
+        int pos = 0;
+        for (quint32 k = 0; k < count; ++k) {
+            quint32 gap, length;
+            if (!getVarint(p, end, &gap) || !getVarint(p, end, &length) || p >= end)
+                return false;
+            const quint8 cls = *p++;
+            if (cls >= kTokenClassCount || gap > 0x7fffffff - quint32(pos) || length > 0x7fffffff)
+                return false;
+            lines->tokens.append({ pos + int(gap), int(length), TokenClass(cls) });
+            pos += int(gap + length);
+        }
+        lines->states.append(int(state));
+        lines->tokenEnds.append(int(lines->tokens.size()));
+    }
+    return p == end;
+}
+
+}
+
+QString HighlightCache::cacheDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/highlight";
+}
+
+void HighlightCache::addToHash(QCryptographicHash& hash, const TextSnapshot& text,
+                               qint64 position, qint64 length)
+{
+    text.forEachSpan(position, length, [&hash](QStringView span) {
+        hash.addData(QByteArrayView(reinterpret_cast<const char*>(span.utf16()),
+                                    span.size() * qsizetype(sizeof(char16_t))));
+    });
+}
+
+bool HighlightCache::read(const QString& path, Entry* entry)
+{
+    const QFileInfo info(path);
+    QFile file(entryFile(path));
+    if (!info.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream s(&file);
+    s.setVersion(QDataStream::Qt_6_0);
+    quint32 magic;
+    quint16 version;
+    QString storedPath;
+    qint64 size, modified;
+    qint32 lineCount, tokenCount;
+    QByteArray payload;
+    s >> magic >> version;
+    if (magic != kMagic || version != kVersion)
+        return false;
+    s >> storedPath >> size >> modified;
+    if (storedPath != path || size != info.size() || modified != modifiedTime(info))
+        return false;
+    s >> entry->grammar >> entry->textHash >> lineCount >> tokenCount >> payload;
+    if (s.status() != QDataStream::Ok || lineCount < 0 || tokenCount < 0)
+        return false;
+    file.close();
+
+    entry->lines = LexedLines();
+    if (!decode(payload, lineCount, tokenCount, &entry->lines))
+        return false;
+
+    // The modification time of an entry is when it was last used.
+    if (file.open(QIODevice::ReadWrite))
+        file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+    return true;
+}
+
+void HighlightCache::store(const QString& path, const TextSnapshot& text, const Entry& entry)
+{
+    QThreadPool::globalInstance()->start([path, text, entry]() {
+        Entry hashed = entry;
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        addToHash(hash, text, 0, text.length());
+        hashed.textHash = hash.result();
+        write(path, hashed);
+        trim();
+    });
+}
+
+void HighlightCache::write(const QString& path, const Entry& entry)
+{
+    const QFileInfo info(path);
+    if (!info.exists() || !QDir().mkpath(cacheDir()))
+        return;
+
+    // Written aside and renamed, so a reader never sees half an entry.
+    QSaveFile file(entryFile(path));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream s(&file);
+    s.setVersion(QDataStream::Qt_6_0);
+    s << kMagic << kVersion << path << qint64(info.size()) << modifiedTime(info)
+      << entry.grammar << entry.textHash << qint32(entry.lines.lineCount())
+      << qint32(entry.lines.tokens.size()) << encode(entry.lines);
+    file.commit();
+}
+
+void HighlightCache::trim()
+{
+    QFileInfoList files = QDir(cacheDir()).entryInfoList({ "*.tokens" }, QDir::Files, QDir::Time);
+    qint64 total = 0;
+    for (const QFileInfo& f : std::as_const(files))
+        total += f.size();
+
+    // Newest first; drop from the end.
+    while (total > kMaxCacheBytes && !files.isEmpty()) {
+        const QFileInfo oldest = files.takeLast();
+        if (QFile::remove(oldest.absoluteFilePath()))
+            total -= oldest.size();
+    }
+}
+
+HighlightCacheReader::HighlightCacheReader(const QString& path, QObject* parent)
+    : QObject(parent), path_(path)
+{}
+
+void HighlightCacheReader::run()
+{
+    HighlightCache::Entry entry;
+    const bool ok = HighlightCache::read(path_, &entry);
+    emit finished(ok, ok ? entry : HighlightCache::Entry());
+}
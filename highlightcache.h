@@ -0,0 +1,66 @@
+#pragma once
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include "backgroundlexer.h"
+#include "textbuffer.h"
+
+class QCryptographicHash;
+
+// Token streams of large files kept between sessions, so a file that has
+// not changed is coloured as soon as it is open rather than after a full
+// background pass. One entry per file under the user cache directory,
+// keyed by path, size and modification time, and carrying a hash of the
+// text it was lexed from that the highlighter checks once it is shown.
+//
+// Entries are compact: per line the end state and the tokens as varint
+// (gap, length) pairs with a class byte. The directory is capped in size;
+// the least recently used entries go first.
+class HighlightCache {
+public:
+    struct Entry {
+        QString grammar;      // name of the grammar that lexed it
+        QByteArray textHash;  // see addToHash()
+        LexedLines lines;     // every line, from line 0 in the initial state
+    };
+
+    // Files smaller than this are lexed quickly enough as it is.
+    static constexpr qint64 kMinFileSize = 256 * 1024;
+
+    static QString cacheDir();
+
+    // Feeds [position, position + length) of text to hash. Entries hash
+    // the whole text this way; callers may do it in pieces.
+    static void addToHash(QCryptographicHash& hash, const TextSnapshot& text,
+                          qint64 position, qint64 length);
+
+    // The entry for path, if there is one for the file as it is on disk
+    // now. Marks it as used. Any thread.
+    static bool read(const QString& path, Entry* entry);
+
+    // Hashes text and writes the entry for path on the global thread pool,
+    // then trims the directory to its cap.
+    static void store(const QString& path, const TextSnapshot& text, const Entry& entry);
+
+private:
+    static void write(const QString& path, const Entry& entry);
+    static void trim();
+};
+
+// Reads the entry of a file being opened. Move to a QThread and invoke
+// run() from its started().
+class HighlightCacheReader : public QObject {
+    Q_OBJECT
+public:
+    explicit HighlightCacheReader(const QString& path, QObject* parent = nullptr);
+
+public slots:
+    void run();
+
+signals:
+    // ok is false when there is no usable entry.
+    void finished(bool ok, const HighlightCache::Entry& entry);
+
+private:
+    QString path_;
+};
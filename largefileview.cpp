@@ -0,0 +1,470 @@
+#include "largefileview.h"
+#include "gzipsource.h"
+
+#include <QPainter>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <QThread>
+#include <cstring>
+
+namespace {
+// Lines longer than this are shown in pieces so a file without newlines
+// cannot make a single scan walk the whole mapping.
+constexpr qint64 kMaxLineBytes = 64 * 1024;
+// Keep the scrollbar range well inside int.
+constexpr qint64 kMaxScrollRange = 1 << 30;
+constexpr int kMargin = 4;
+}
+
+LargeFileView::LargeFileView(QWidget* parent)
+    : QAbstractScrollArea(parent)
+{
+    setFont(QFont("Consolas", 11));
+    setFocusPolicy(Qt::StrongFocus);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    viewport()->setAutoFillBackground(true);
+    setDarkMode(false);
+}
+
+LargeFileView::~LargeFileView()
+{
+    closeFile();
+}
+
+bool LargeFileView::openFile(const QString& path)
+{
+    closeFile();
+    path_ = path;
+    topOffset_ = 0;
+    maxLineWidth_ = 0;
+
+    // The source is created once the seek points exist.
+    if (GzipSource::isCompressed(path)) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        compressed_ = true;
+        decompressPercent_ = 0;
+        updateScrollBars();
+        viewport()->update();
+        startDecompressing();
+        return true;
+    }
+
+    auto source = std::make_unique<MappedSource>();
+    if (!source->open(path))
+        return false;
+
+    size_ = source->size();
+    source_ = std::move(source);
+    updateScrollBars();
+    viewport()->update();
+    startIndexing();
+    return true;
+}
+
+void LargeFileView::closeFile()
+{
+    stopIndexing();
+    index_ = LineIndex();
+    source_.reset();
+    compressed_ = false;
+    size_ = 0;
+    topOffset_ = 0;
+}
+
+void LargeFileView::startIndexing()
+{
+    auto* thread = new QThread;
+    auto* indexer = new LineIndexer(path_);
+    indexer->moveToThread(thread);
+
+    connect(thread, &QThread::started, indexer, &LineIndexer::run);
+    connect(indexer, &LineIndexer::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, indexer, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    // A cancelled indexer may still deliver its result; the id drops it.
+    const int id = ++indexId_;
+    connect(indexer, &LineIndexer::finished, this, [this, id](const LineIndex& index) {
+        if (id != indexId_)
+            return;
+        indexer_ = nullptr;
+        indexerThread_ = nullptr;
+        index_ = index;
+        viewport()->update();
+    });
+
+    indexer_ = indexer;
+    indexerThread_ = thread;
+    thread->start();
+}
+
+void LargeFileView::startDecompressing()
+{
+    auto* thread = new QThread;
+    auto* indexer = new GzipIndexer(path_);
+    indexer->moveToThread(thread);
+
+    connect(thread, &QThread::started, indexer, &GzipIndexer::run);
+    connect(indexer, &GzipIndexer::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, indexer, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    const int id = ++indexId_;
+    connect(indexer, &GzipIndexer::progress, this, [this, id](qint64 done, qint64 total) {
+        if (id != indexId_ || total <= 0)
+            return;
+        const int percent = int(done * 100 / total);
+        if (percent != decompressPercent_) {
+            decompressPercent_ = percent;
+            viewport()->update();
+        }
+    });
+    connect(indexer, &GzipIndexer::finished, this,
+            [this, id](const GzipIndex& index, const LineIndex& lines) {
+        if (id != indexId_)
+            return;
+        gzipIndexer_ = nullptr;
+        indexerThread_ = nullptr;
+
+        auto source = std::make_unique<GzipSource>(path_, index);
+        if (source->open()) {
+            size_ = source->size();
+            source_ = std::move(source);
+            index_ = lines;
+        }
+        updateScrollBars();
+        viewport()->update();
+    });
+
+    gzipIndexer_ = indexer;
+    indexerThread_ = thread;
+    thread->start();
+}
+
+void LargeFileView::stopIndexing()
+{
+    if (!indexerThread_)
+        return;
+
+    if (indexer_)
+        indexer_->cancel();
+    if (gzipIndexer_)
+        gzipIndexer_->cancel();
+
+    indexerThread_->quit();
+    indexerThread_->wait();
+    ++indexId_;
+
+    indexer_ = nullptr;
+    gzipIndexer_ = nullptr;
+    indexerThread_ = nullptr;
+}
+
+int LargeFileView::gutterWidth() const
+{
+    if (!index_.isValid())
+        return 0;
+    const int digits = QString::number(index_.lineCount()).length();
+    return 10 + fontMetrics().horizontalAdvance('9') * digits;
+}
+
+void LargeFileView::goToLine(qint64 line)
+{
+    if (!source_)
+        return;
+
+    // Keep the target line a few rows below the top edge.
+    scrollToLine(line);
+    scrollLines(-qMin(3, visibleLineCount() / 2));
+}
+
+void LargeFileView::scrollToLine(qint64 line)
+{
+    if (!source_)
+        return;
+
+    if (index_.isValid())
+        topOffset_ = index_.lineStart(*source_, line);
+    else
+        topOffset_ = LineIndex::skipLines(*source_, 0, qMax<qint64>(0, line));
+
+    syncScrollBar();
+    viewport()->update();
+}
+
+void LargeFileView::setDarkMode(bool enabled)
+{
+    QPalette p = palette();
+
+    if (enabled) {
+        p.setColor(QPalette::Base, QColor(42,42,42));
+        p.setColor(QPalette::Text, Qt::white);
+    } else {
+        p.setColor(QPalette::Base, QColor(255,255,255));
+        p.setColor(QPalette::Text, QColor(30,30,30));
+    }
+
+    setPalette(p);
+    viewport()->setPalette(p);
+    viewport()->update();
+}
+
+uchar LargeFileView::byteAt(qint64 offset) const
+{
+    const QByteArrayView b = source_->bytes(offset, 1);
+    return b.isEmpty() ? 0 : uchar(b[0]);
+}
+
+qint64 LargeFileView::lineStartBefore(qint64 offset) const
+{
+    if (offset <= 0 || !source_)
+        return 0;
+    if (offset > size_)
+        offset = size_;
+
+    const qint64 limit = qMax<qint64>(0, offset - kMaxLineBytes);
+    const QByteArrayView span = source_->bytes(limit, offset - limit);
+    for (qint64 i = span.size() - 1; i >= 0; --i) {
+        if (span[i] == '\n')
+            return limit + i + 1;
+    }
+    return limit;
+}
+
+qint64 LargeFileView::nextLineStart(qint64 offset) const
+{
+    if (!source_ || offset >= size_)
+        return size_;
+
+    const QByteArrayView span = source_->bytes(offset, qMin(size_ - offset, kMaxLineBytes));
+    const void* nl = std::memchr(span.data(), '\n', size_t(span.size()));
+    if (nl)
+        return offset + (static_cast<const char*>(nl) - span.data()) + 1;
+    return offset + span.size();
+}
+
+QString LargeFileView::lineText(qint64 start, qint64 end) const
+{
+    const QByteArrayView span = source_->bytes(start, end - start);
+    qint64 len = span.size();
+    while (len > 0 && (span[len - 1] == '\n' || span[len - 1] == '\r'))
+        --len;
+
+    QString text = QString::fromUtf8(span.data(), len);
+    text.replace('\t', QStringLiteral("    "));
+    return text;
+}
+
+int LargeFileView::visibleLineCount() const
+{
+    const int lineHeight = fontMetrics().height();
+    return lineHeight > 0 ? viewport()->height() / lineHeight : 0;
+}
+
+qint64 LargeFileView::bottomOffset() const
+{
+    qint64 bottom = topOffset_;
+    for (int i = 0, n = qMax(1, visibleLineCount()); i < n && bottom < size_; ++i)
+        bottom = nextLineStart(bottom);
+    return bottom;
+}
+
+void LargeFileView::scrollToEnd()
+{
+    topOffset_ = lineStartBefore(size_);
+    scrollLines(-qMax(0, visibleLineCount() - 1));
+}
+
+bool LargeFileView::refresh()
+{
+    if (compressed_)
+        return true;
+    if (!source_)
+        return false;
+
+    const bool follow = isAtEnd();
+    if (!source_->refresh())
+        return openFile(path_);
+
+    const qint64 oldSize = size_;
+    size_ = source_->size();
+    if (size_ == oldSize)
+        return true;
+
+    if (index_.isValid()) {
+        for (qint64 pos = oldSize; pos < size_;) {
+            const QByteArrayView span = source_->bytes(pos, size_ - pos);
+            index_.append(reinterpret_cast<const uchar*>(span.data()), span.size());
+            pos += span.size();
+        }
+    } else if (indexerThread_) {
+        stopIndexing();
+        startIndexing();
+    }
+
+    updateScrollBars();
+    if (follow)
+        scrollToEnd();
+    viewport()->update();
+    return true;
+}
+
+void LargeFileView::scrollLines(int lines)
+{
+    if (!source_)
+        return;
+
+    if (lines > 0) {
+        for (int i = 0; i < lines; ++i) {
+            qint64 next = nextLineStart(topOffset_);
+            if (next >= size_)
+                break;
+            topOffset_ = next;
+        }
+    } else {
+        for (int i = 0; i < -lines && topOffset_ > 0; ++i)
+            topOffset_ = lineStartBefore(topOffset_ - 1);
+    }
+
+    syncScrollBar();
+    viewport()->update();
+}
+
+void LargeFileView::updateScrollBars()
+{
+    shift_ = 0;
+    while ((size_ >> shift_) > kMaxScrollRange)
+        ++shift_;
+
+    // Page step in bytes: what the current viewport actually shows.
+    const qint64 bottom = bottomOffset();
+
+    syncing_ = true;
+    QScrollBar* vsb = verticalScrollBar();
+    vsb->setRange(0, int(size_ >> shift_));
+    vsb->setPageStep(qMax(1, int((bottom - topOffset_) >> shift_)));
+    vsb->setValue(int(topOffset_ >> shift_));
+
+    QScrollBar* hsb = horizontalScrollBar();
+    hsb->setRange(0, qMax(0, maxLineWidth_ - viewport()->width()));
+    hsb->setPageStep(viewport()->width());
+    hsb->setSingleStep(fontMetrics().horizontalAdvance(' ') * 4);
+    syncing_ = false;
+}
+
+void LargeFileView::syncScrollBar()
+{
+    syncing_ = true;
+    verticalScrollBar()->setValue(int(topOffset_ >> shift_));
+    syncing_ = false;
+}
+
+void LargeFileView::scrollContentsBy(int, int dy)
+{
+    if (dy != 0 && !syncing_)
+        topOffset_ = lineStartBefore(qint64(verticalScrollBar()->value()) << shift_);
+
+    viewport()->update();
+}
+
+void LargeFileView::wheelEvent(QWheelEvent* event)
+{
+    const int steps = event->angleDelta().y() / 120;
+    if (steps != 0) {
+        scrollLines(-steps * 3);
+        event->accept();
+        return;
+    }
+    QAbstractScrollArea::wheelEvent(event);
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent* event)
+{
+    switch (event->key()) {
+    case Qt::Key_Up:       scrollLines(-1); break;
+    case Qt::Key_Down:     scrollLines(1); break;
+    case Qt::Key_PageUp:   scrollLines(-qMax(1, visibleLineCount() - 1)); break;
+    case Qt::Key_PageDown: scrollLines(qMax(1, visibleLineCount() - 1)); break;
+    case Qt::Key_Home:
+        topOffset_ = 0;
+        syncScrollBar();
+        viewport()->update();
+        break;
+    case Qt::Key_End:      scrollToEnd(); break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+    event->accept();
+}
+
+void LargeFileView::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void LargeFileView::paintEvent(QPaintEvent*)
+{
+    QPainter p(viewport());
+    p.fillRect(viewport()->rect(), palette().color(QPalette::Base));
+
+    p.setFont(font());
+    p.setPen(palette().color(QPalette::Text));
+
+    if (!source_) {
+        if (compressed_) {
+            const QString status = indexerThread_
+                ? QString("Decompressing... %1%").arg(decompressPercent_)
+                : QString("Not a readable gzip or zlib stream.");
+            p.drawText(viewport()->rect().adjusted(kMargin, kMargin, 0, 0),
+                       Qt::AlignLeft | Qt::AlignTop, status);
+        }
+        return;
+    }
+
+    const QFontMetrics fm = fontMetrics();
+    const int lineHeight = fm.height();
+    const int gutter = gutterWidth();
+    const int x = gutter + kMargin - horizontalScrollBar()->value();
+
+    qint64 offset = topOffset_;
+    int widest = maxLineWidth_;
+
+    // Pieces of an over-long line do not get a number of their own.
+    qint64 line = gutter ? index_.lineAt(*source_, offset) : 0;
+    bool atLineStart = offset == 0 || byteAt(offset - 1) == '\n';
+    QList<QPair<int, qint64>> numbers;
+
+    for (int y = 0; y < viewport()->height() && offset < size_; y += lineHeight) {
+        const qint64 next = nextLineStart(offset);
+        const QString text = lineText(offset, next);
+
+        p.drawText(x, y + fm.ascent(), text);
+        widest = qMax(widest, fm.horizontalAdvance(text) + 2 * kMargin + gutter);
+
+        if (atLineStart)
+            numbers.append({ y, line });
+        atLineStart = byteAt(next - 1) == '\n';
+        line += atLineStart;
+
+        offset = next;
+    }
+
+    if (gutter) {
+        QPalette pal = palette();
+        p.fillRect(0, 0, gutter, viewport()->height(), pal.color(QPalette::Button));
+        p.setPen(pal.color(QPalette::Text));
+        for (const auto& [y, number] : std::as_const(numbers))
+            p.drawText(0, y, gutter - kMargin, lineHeight, Qt::AlignRight, QString::number(number + 1));
+    }
+
+    if (widest != maxLineWidth_) {
+        maxLineWidth_ = widest;
+        horizontalScrollBar()->setRange(0, qMax(0, maxLineWidth_ - viewport()->width()));
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <QAbstractScrollArea>
+#include <QPointer>
+#include <memory>
+#include "bytesource.h"
+#include "lineindex.h"
+
+class QThread;
+class GzipIndexer;
+struct GzipIndex;
+
+// Read-only viewer for files too large for QPlainTextEdit.
+// The file is memory-mapped and only the lines inside the viewport are
+// decoded, so memory and time to first paint do not depend on file size.
+// gzip/zlib files are read through a GzipSource instead, once a worker
+// has built its seek points; until then the view shows the progress.
+// The vertical scrollbar is a byte-offset model: its value is a (shifted)
+// file offset and the view snaps to the start of the line containing it.
+// Line numbers come from a LineIndex built on a worker thread after open.
+class LargeFileView : public QAbstractScrollArea {
+    Q_OBJECT
+public:
+    explicit LargeFileView(QWidget* parent = nullptr);
+    ~LargeFileView() override;
+
+    bool openFile(const QString& path);
+    void closeFile();
+    qint64 fileSize() const { return size_; }
+    QString filePath() const { return path_; }
+    bool isCompressed() const { return compressed_; }
+
+    void setDarkMode(bool enabled);
+    void scrollLines(int lines);
+    void scrollToEnd();
+    bool isAtEnd() const { return bottomOffset() >= size_; }
+
+    // Picks up bytes appended since the file was mapped. Only the new part
+    // is scanned; a file that shrank is reopened from scratch. Compressed
+    // files are not followed.
+    bool refresh();
+
+    // 0-based. Works before indexing has finished, by scanning from the top.
+    void goToLine(qint64 line);
+    // Same, but with the line exactly at the top edge.
+    void scrollToLine(qint64 line);
+    // -1 until the line index is ready.
+    qint64 lineCount() const { return index_.isValid() ? index_.lineCount() : -1; }
+    // 0-based line at the top of the viewport (0 while indexing).
+    qint64 topLine() const { return source_ ? index_.lineAt(*source_, topOffset_) : 0; }
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+
+private:
+    qint64 lineStartBefore(qint64 offset) const;
+    qint64 nextLineStart(qint64 offset) const;
+    QString lineText(qint64 start, qint64 end) const;
+    int visibleLineCount() const;
+    qint64 bottomOffset() const;
+    void updateScrollBars();
+    void syncScrollBar();
+    uchar byteAt(qint64 offset) const;
+    void startIndexing();
+    void startDecompressing();
+    void stopIndexing();
+    int gutterWidth() const;
+
+    QString path_;
+    std::unique_ptr<ByteSource> source_;
+    qint64 size_ = 0;
+    bool compressed_ = false;
+    int decompressPercent_ = 0;
+
+    qint64 topOffset_ = 0;  // byte offset of the first visible line
+    int shift_ = 0;         // offset >> shift_ == scrollbar value
+    int maxLineWidth_ = 0;
+    bool syncing_ = false;
+
+    LineIndex index_;
+    QPointer<LineIndexer> indexer_;
+    QPointer<GzipIndexer> gzipIndexer_;
+    QPointer<QThread> indexerThread_;
+    int indexId_ = 0;
+};
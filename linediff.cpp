@@ -0,0 +1,174 @@
+#include "linediff.h"
+#include "textdecoder.h"
+
+#include <QFile>
+#include <QHash>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Reloads read the file in pieces of this size, like FileLoader.
+constexpr qint64 kReadBytes = 1024 * 1024;
+
+// Matched (a, b) index pairs of a shortest edit script, in order. Lines
+// are compared as ids, so equal lines compare in O(1). Returns false when
+// the script needs more than maxEdits insertions and deletions.
+bool myersMatches(const std::vector<int>& a, const std::vector<int>& b, int maxEdits,
+                  std::vector<std::pair<int, int>>* matches)
+{
+    const int n = int(a.size());
+    const int m = int(b.size());
+    const int max = std::min(n + m, maxEdits);
+    const int offset = max + 1;
+
+    // v[offset + k]: furthest x reached on diagonal k. trace[d] keeps
+    // diagonals -d..d as they were before step d, for the backtrack.
+    std::vector<int> v(2 * max + 3, 0);
+    std::vector<std::vector<int>> trace;
+
+    for (int d = 0; d <= max; ++d) {
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+
+            if (x < n || y < m)
+                continue;
+
+            // Walk back from the end, collecting the diagonal runs.
+            matches->clear();
+            x = n;
+            y = m;
+            for (int e = d; e >= 0; --e) {
+                const std::vector<int>& w = trace[e];
+                auto at = [&](int diagonal) { return w[diagonal + e]; };
+
+                const int kk = x - y;
+                const int prevK = (kk == -e || (kk != e && at(kk - 1) < at(kk + 1))) ? kk + 1 : kk - 1;
+                const int prevX = e > 0 ? at(prevK) : 0;
+                const int prevY = e > 0 ? prevX - prevK : 0;
+
+                while (x > prevX && y > prevY) {
+                    --x;
+                    --y;
+                    matches->emplace_back(x, y);
+                }
+                x = prevX;
+                y = prevY;
+            }
+            std::reverse(matches->begin(), matches->end());
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+QVector<LineDiff::Hunk> LineDiff::compute(const QStringList& from, const QStringList& to)
+{
+    const int n = int(from.size());
+    const int m = int(to.size());
+
+    int prefix = 0;
+    while (prefix < n && prefix < m && from[prefix] == to[prefix])
+        ++prefix;
+    int suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix
+           && from[n - 1 - suffix] == to[m - 1 - suffix])
+        ++suffix;
+
+    const int oldCount = n - prefix - suffix;
+    const int newCount = m - prefix - suffix;
+    QVector<Hunk> hunks;
+    if (oldCount == 0 && newCount == 0)
+        return hunks;
+
+    // Number the distinct lines of the middle part.
+    QHash<QString, int> ids;
+    std::vector<int> a(oldCount);
+    std::vector<int> b(newCount);
+    for (int i = 0; i < oldCount; ++i)
+        a[i] = ids.insert(from[prefix + i], int(ids.size())).value();
+    for (int i = 0; i < newCount; ++i) {
+        const auto it = ids.constFind(to[prefix + i]);
+        b[i] = it != ids.constEnd() ? it.value() : -1 - i;
+    }
+
+    std::vector<std::pair<int, int>> matches;
+    if (!myersMatches(a, b, kMaxEdits, &matches))
+        matches.clear();   // too different: one hunk for the whole middle
+
+    int x = 0;
+    int y = 0;
+    matches.emplace_back(oldCount, newCount);   // sentinel
+    for (const auto& [mx, my] : matches) {
+        if (mx > x || my > y) {
+            Hunk hunk;
+            hunk.oldStart = prefix + x;
+            hunk.oldCount = mx - x;
+            hunk.lines = to.mid(prefix + y, my - y);
+            hunks.append(hunk);
+        }
+        x = mx + 1;
+        y = my + 1;
+    }
+    return hunks;
+}
+
+ReloadDiffer::ReloadDiffer(const QString& path, const TextSnapshot& text, const TextFormat& format,
+                           QObject* parent)
+    : QObject(parent), path_(path), text_(text), format_(format)
+{}
+
+void ReloadDiffer::run()
+{
+    QFile file(path_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit finished(false, {});
+        return;
+    }
+
+    // Streamed through the same decoder as FileLoader, so invalid bytes
+    // become U+FFFD here as they did on load rather than turning the whole
+    // file into Latin-1. The encoding is not detected again; a BOM is only
+    // skipped when it is the one the file was loaded with.
+    TextDecoder decoder(format_.encoding);
+    QString text;
+    bool first = true;
+    while (!file.atEnd()) {
+        const QByteArray bytes = file.read(kReadBytes);
+        if (bytes.isEmpty())
+            break;
+        int bom = 0;
+        if (first && format_.bom
+            && TextDecoder::detect(bytes.constData(), bytes.size(), &bom) != format_.encoding)
+            bom = 0;
+        first = false;
+        text += decoder.feed(bytes.constData() + bom, bytes.size() - bom);
+    }
+
+    // Same normalisation as FileLoader: CRLF -> LF, and a CR at the very
+    // end counts as a line break.
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    if (text.endsWith(QLatin1Char('\r')))
+        text.back() = QLatin1Char('\n');
+
+    QStringList oldLines;
+    oldLines.reserve(text_.lineCount());
+    text_.forEachLine([&](int, QStringView line) {
+        oldLines.append(line.toString());
+        return true;
+    });
+
+    emit finished(true, LineDiff::compute(oldLines, text.split(QLatin1Char('\n'))));
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "textbuffer.h"
+#include "textdecoder.h"
+
+// Line-based diff between two versions of a text, as the hunks that turn
+// the old lines into the new ones. Common leading and trailing lines are
+// skipped first; the rest goes through Myers' O(ND) algorithm. Past
+// kMaxEdits differing lines the middle becomes a single hunk, which is
+// still correct, just coarser.
+class LineDiff {
+public:
+    static constexpr int kMaxEdits = 2000;
+
+    struct Hunk {
+        int oldStart = 0;     // first old line replaced (0-based)
+        int oldCount = 0;     // old lines replaced; 0 for a pure insertion
+        QStringList lines;    // their replacement; empty for a pure removal
+    };
+
+    // Hunks are in ascending order and do not overlap.
+    static QVector<Hunk> compute(const QStringList& from, const QStringList& to);
+};
+
+// Reads a file on a worker thread, decodes it like FileLoader does, in
+// the encoding the document was loaded with, and diffs it against a
+// snapshot of the open document. Move to a QThread and invoke run() from
+// its started().
+class ReloadDiffer : public QObject {
+    Q_OBJECT
+public:
+    ReloadDiffer(const QString& path, const TextSnapshot& text, const TextFormat& format,
+                 QObject* parent = nullptr);
+
+public slots:
+    void run();
+
+signals:
+    // ok is false when the file could not be read.
+    void finished(bool ok, const QVector<LineDiff::Hunk>& hunks);
+
+private:
+    QString path_;
+    TextSnapshot text_;
+    TextFormat format_;
+};
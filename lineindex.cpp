@@ -0,0 +1,237 @@
+#include "lineindex.h"
+#include "simd.h"
+#include "bytesource.h"
+
+#include <QFile>
+#include <algorithm>
+
+namespace {
+// The build loop looks at progress and cancellation this often.
+constexpr qint64 kWindowBytes = 64 * 1024 * 1024;
+// Queries against a ByteSource read it in spans of this size.
+constexpr qint64 kScanBytes = 1024 * 1024;
+
+// Bit i of the result is set when p[i] == '\n', for 64 bytes.
+using MaskKernel = quint64 (*)(const uchar* p);
+
+#ifdef FILEEXPLORER_SSE2
+quint64 newlineMaskSse2(const uchar* p)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    quint64 mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        mask |= quint64(quint16(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)))) << (16 * i);
+    }
+    return mask;
+}
+
+FILEEXPLORER_TARGET_AVX2
+quint64 newlineMaskAvx2(const uchar* p)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    return quint64(quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl))))
+           | quint64(quint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl)))) << 32;
+}
+#endif
+
+quint64 newlineMaskScalar(const uchar* p)
+{
+    quint64 mask = 0;
+    for (int i = 0; i < 64; ++i)
+        mask |= quint64(p[i] == '\n') << i;
+    return mask;
+}
+
+MaskKernel maskKernel()
+{
+    static const MaskKernel kernel = []() -> MaskKernel {
+#ifdef FILEEXPLORER_SSE2
+        return cpuHasAvx2() ? newlineMaskAvx2 : newlineMaskSse2;
+#else
+        return newlineMaskScalar;
+#endif
+    }();
+    return kernel;
+}
+}
+
+qint64 LineIndex::skipLines(const uchar* data, qint64 size, qint64 n, qint64* skipped)
+{
+    const MaskKernel mask = maskKernel();
+    qint64 remaining = n;
+    qint64 i = 0;
+
+    if (remaining > 0) {
+        for (; i + 64 <= size; i += 64) {
+            quint64 m = mask(data + i);
+            const int count = qPopulationCount(m);
+            if (count < remaining) {
+                remaining -= count;
+                continue;
+            }
+            // The target newline is in this block: drop the ones before it.
+            while (--remaining > 0)
+                m &= m - 1;
+            if (skipped)
+                *skipped = n;
+            return i + qCountTrailingZeroBits(m) + 1;
+        }
+
+        for (; i < size; ++i) {
+            if (data[i] == '\n' && --remaining == 0) {
+                if (skipped)
+                    *skipped = n;
+                return i + 1;
+            }
+        }
+    }
+
+    if (skipped)
+        *skipped = n - remaining;
+    return remaining > 0 ? size : 0;
+}
+
+qint64 LineIndex::countNewlines(const uchar* data, qint64 size)
+{
+    const MaskKernel mask = maskKernel();
+    qint64 count = 0;
+    qint64 i = 0;
+
+    for (; i + 64 <= size; i += 64)
+        count += qPopulationCount(mask(data + i));
+    for (; i < size; ++i)
+        count += data[i] == '\n';
+    return count;
+}
+
+qint64 LineIndex::countNewlines(const char16_t* data, qint64 size)
+{
+    qint64 count = 0;
+    qint64 i = 0;
+
+#ifdef FILEEXPLORER_SSE2
+    const __m128i nl = _mm_set1_epi16('\n');
+    for (; i + 8 <= size; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // Each matching 16-bit lane sets two mask bits.
+        count += qPopulationCount(quint32(_mm_movemask_epi8(_mm_cmpeq_epi16(v, nl)))) / 2;
+    }
+#endif
+    for (; i < size; ++i)
+        count += data[i] == u'\n';
+    return count;
+}
+
+LineIndex LineIndex::build(const uchar* data, qint64 size,
+                           const std::function<bool(qint64)>& progress)
+{
+    LineIndex index;
+    index.samples_.reserve(int(qMin<qint64>(size / (kStride * 40), 1 << 24)) + 1);
+
+    index.append(data, 0);
+
+    for (qint64 pos = 0; pos < size;) {
+        const qint64 window = qMin(size - pos, kWindowBytes);
+        index.append(data + pos, window);
+        pos += window;
+        if (progress && !progress(pos))
+            return LineIndex();
+    }
+    return index;
+}
+
+void LineIndex::append(const uchar* data, qint64 length)
+{
+    if (samples_.isEmpty()) {
+        samples_.append(0);
+        lineCount_ = 1;
+    }
+
+    qint64 line = lineCount_ - 1;    // newlines before size_
+    qint64 nextSample = qint64(samples_.size()) * kStride;
+    qint64 pos = 0;
+
+    while (pos < length) {
+        qint64 skipped = 0;
+        pos += skipLines(data + pos, length - pos, nextSample - line, &skipped);
+        line += skipped;
+
+        if (line == nextSample) {
+            samples_.append(size_ + pos);
+            nextSample += kStride;
+        }
+    }
+
+    lineCount_ = line + 1;
+    size_ += length;
+}
+
+qint64 LineIndex::skipLines(ByteSource& source, qint64 offset, qint64 n)
+{
+    const qint64 size = source.size();
+
+    while (n > 0 && offset < size) {
+        const QByteArrayView span = source.bytes(offset, kScanBytes);
+        qint64 skipped = 0;
+        offset += skipLines(reinterpret_cast<const uchar*>(span.data()), span.size(), n, &skipped);
+        n -= skipped;
+    }
+    return qMin(offset, size);
+}
+
+qint64 LineIndex::lineStart(ByteSource& source, qint64 line) const
+{
+    if (!isValid() || line <= 0)
+        return 0;
+    line = qMin(line, lineCount_ - 1);
+
+    return skipLines(source, samples_[line / kStride], line % kStride);
+}
+
+qint64 LineIndex::lineAt(ByteSource& source, qint64 offset) const
+{
+    if (!isValid() || offset <= 0)
+        return 0;
+
+    const auto it = std::upper_bound(samples_.cbegin(), samples_.cend(), offset) - 1;
+    qint64 line = qint64(it - samples_.cbegin()) * kStride;
+
+    for (qint64 pos = *it; pos < offset;) {
+        const QByteArrayView span = source.bytes(pos, qMin(offset - pos, kScanBytes));
+        if (span.isEmpty())
+            break;
+        line += countNewlines(reinterpret_cast<const uchar*>(span.data()), span.size());
+        pos += span.size();
+    }
+    return line;
+}
+
+LineIndexer::LineIndexer(const QString& path, QObject* parent)
+    : QObject(parent), path_(path)
+{}
+
+void LineIndexer::run()
+{
+    QFile file(path_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit finished(LineIndex());
+        return;
+    }
+
+    const qint64 size = file.size();
+    const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    if (size > 0 && !data) {
+        emit finished(LineIndex());
+        return;
+    }
+
+    const LineIndex index = LineIndex::build(data, size, [this, size](qint64 done) {
+        emit progress(done, size);
+        return !isCancelled();
+    });
+
+    emit finished(index);
+}
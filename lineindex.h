@@ -0,0 +1,73 @@
+#pragma once
+#include <QObject>
+#include <QAtomicInt>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+class ByteSource;
+
+// Sparse line-start index over a byte stream (usually a mapped file).
+// Only every kStride-th line start is stored, so a file with 40 million
+// lines needs about 1 MB; the lines in between are found with the same
+// vectorized newline scan that builds the index.
+class LineIndex {
+public:
+    static constexpr qint64 kStride = 256;
+
+    LineIndex() = default;
+
+    // progress(bytesDone) is called now and then; return false to cancel,
+    // in which case the returned index is not valid.
+    static LineIndex build(const uchar* data, qint64 size,
+                           const std::function<bool(qint64)>& progress = {});
+
+    // Adds the next bytes of the stream, for indexes built as data arrives
+    // (decompression) or files that grow.
+    void append(const uchar* data, qint64 length);
+    // Bytes covered so far.
+    qint64 size() const { return size_; }
+
+    bool isValid() const { return lineCount_ > 0; }
+    qint64 lineCount() const { return lineCount_; }
+
+    // source must hold the bytes the index was built from.
+    qint64 lineStart(ByteSource& source, qint64 line) const;
+    qint64 lineAt(ByteSource& source, qint64 offset) const;
+
+    // Offset just past the n-th '\n' in data, or size if there are fewer.
+    // skipped receives the number of newlines actually passed.
+    static qint64 skipLines(const uchar* data, qint64 size, qint64 n, qint64* skipped = nullptr);
+    // Same, over source from offset on.
+    static qint64 skipLines(ByteSource& source, qint64 offset, qint64 n);
+    static qint64 countNewlines(const uchar* data, qint64 size);
+    static qint64 countNewlines(const char16_t* data, qint64 size);
+
+private:
+    QVector<qint64> samples_;   // start of lines 0, kStride, 2 * kStride, ...
+    qint64 lineCount_ = 0;
+    qint64 size_ = 0;
+};
+
+// Builds a LineIndex for a file on a worker thread. It maps the file
+// itself, so the view that asked for it can close at any time. Move to a
+// QThread and invoke run() from its started().
+class LineIndexer : public QObject {
+    Q_OBJECT
+public:
+    explicit LineIndexer(const QString& path, QObject* parent = nullptr);
+
+    void cancel() { cancelled_.storeRelaxed(1); }
+    bool isCancelled() const { return cancelled_.loadRelaxed() != 0; }
+
+public slots:
+    void run();
+
+signals:
+    void progress(qint64 bytesDone, qint64 totalBytes);
+    void finished(const LineIndex& index);
+
+private:
+    QString path_;
+    QAtomicInt cancelled_;
+};
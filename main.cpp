@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "codeviewerwindow.h"
 #include <QStyleFactory>
 #include <QApplication>
 
@@ -28,6 +29,7 @@ int main(int argc, char *argv[])
 
     QApplication::setApplicationName("ALBRHYTHM File Explorer");
     QGuiApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::PassThrough);
+    CodeViewerWindow::loadHighlightingSettings();
 
     MainWindow w;
     w.show();
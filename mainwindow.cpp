@@ -4,6 +4,10 @@
 #include "iconfactory.h"
 #include "iconprovider.h"
 #include "ribbongroup.h"
+#include "textdecoder.h"
+#include "editjournal.h"
+#include "grammar.h"
+#include "pendingtab.h"
 
 #include <QFileSystemModel>
 #include <QTreeView>
@@ -12,6 +16,8 @@
 #include <QSplitter>
 #include <QToolBar>
 #include <QMenuBar>
+#include <QMenu>
+#include <QTabBar>
 #include <QFileDialog>
 #include <QDesktopServices>
 #include <QUrl>
@@ -31,6 +37,9 @@
 #include <qapplication.h>
 #include <qheaderview.h>
 #include <QDockWidget>
+#include <QTimer>
+#include <QSettings>
+#include <QCloseEvent>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -195,16 +204,12 @@ MainWindow::MainWindow(QWidget *parent)
             return;
         }
 
-        if (path.endsWith(".cpp") || path.endsWith(".h") || path.endsWith(".hpp")) {
+        if (Grammar::find(path)) {
 
             if (!editorDock_->isVisible())
                 editorDock_->show();
 
-            CodeViewer* viewer = new CodeViewer(this);
-            viewer->loadFile(path);
-
-            int tabIndex = editorTabs_->addTab(viewer, QFileInfo(path).fileName());
-            editorTabs_->setCurrentIndex(tabIndex);
+            openInEditorDock(path);
         }
     });
 
@@ -216,6 +221,26 @@ MainWindow::MainWindow(QWidget *parent)
     editorTabs_->setTabsClosable(true);
     editorTabs_->setMovable(true);
 
+    // The dock has no menu bar; its editor actions hang off the tab bar,
+    // and Ctrl+G works anywhere inside the dock.
+    QAction* goToLineAction = new QAction("Go to Line...", editorDock_);
+    goToLineAction->setShortcut(QKeySequence("Ctrl+G"));
+    goToLineAction->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+    editorDock_->addAction(goToLineAction);
+    connect(goToLineAction, &QAction::triggered, this, [this]() {
+        if (auto* viewer = qobject_cast<CodeViewer*>(editorTabs_->currentWidget()))
+            CodeViewerWindow::promptGoToLine(viewer, this);
+    });
+
+    editorTabs_->tabBar()->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(editorTabs_->tabBar(), &QWidget::customContextMenuRequested, this, [this, goToLineAction](const QPoint& pos) {
+        QMenu menu;
+        menu.addAction(goToLineAction);
+        QAction* budgetAction = menu.addAction("Highlighting Time Budget...");
+        if (menu.exec(editorTabs_->tabBar()->mapToGlobal(pos)) == budgetAction)
+            CodeViewerWindow::editTimeBudget(this);
+    });
+
     editorDock_->setWidget(editorTabs_);
     addDockWidget(Qt::RightDockWidgetArea, editorDock_);
 
@@ -228,7 +253,7 @@ MainWindow::MainWindow(QWidget *parent)
     connect(list_, &QTreeView::doubleClicked, this, [this](const QModelIndex& index) {
         QString path = fsModel_->filePath(index);
 
-        if (path.endsWith(".cpp") || path.endsWith(".h") || path.endsWith(".hpp")) {
+        if (Grammar::find(path)) {
 
             if (!editorDock_->isVisible()) {
                 editorDock_->show();
@@ -238,11 +263,7 @@ MainWindow::MainWindow(QWidget *parent)
                 mainSplit->setSizes(sizes);
             }
 
-            CodeViewer* viewer = new CodeViewer(this);
-            viewer->loadFile(path);
-
-            int tabIndex = editorTabs_->addTab(viewer, QFileInfo(path).fileName());
-            editorTabs_->setCurrentIndex(tabIndex);
+            openInEditorDock(path);
         }
     });
     connect(editorTabs_, &QTabWidget::tabCloseRequested, this, [this](int index) {
@@ -253,6 +274,8 @@ MainWindow::MainWindow(QWidget *parent)
         if (editorTabs_->count() == 0)
             editorDock_->hide();
     });
+    // Restored tabs are only loaded once they are looked at.
+    connect(editorTabs_, &QTabWidget::currentChanged, this, &MainWindow::materializeEditorTab);
 
 
 
@@ -262,6 +285,12 @@ MainWindow::MainWindow(QWidget *parent)
     setupConnections();
     resize(1200, 800);
     setMinimumSize(1000, 700);
+
+    // Recovered files come first; the session then skips them.
+    QTimer::singleShot(0, this, [this]() {
+        recoverUnsavedEdits();
+        restoreSession();
+    });
 }
 
 void MainWindow::setupActions() {
@@ -457,22 +486,140 @@ void MainWindow::openSelected() {
 
     QString path = fsModel_->filePath(idx);
 
-    // Only open code files
-    if (!path.endsWith(".cpp") &&
-        !path.endsWith(".h") &&
-        !path.endsWith(".hpp"))
+    // Only open files a grammar claims
+    if (!Grammar::find(path))
         return;
 
     // Show the dock if hidden
     if (!editorDock_->isVisible())
         editorDock_->show();
 
-    // Create a new CodeViewer for this file
+    openInEditorDock(path);
+}
+
+CodeViewer* MainWindow::openInEditorDock(const QString& path)
+{
+    // A file that already has a tab just gets focus.
+    const int existing = PendingTab::indexOf(editorTabs_, path);
+    if (existing >= 0) {
+        editorTabs_->setCurrentIndex(existing);
+        return qobject_cast<CodeViewer*>(editorTabs_->widget(existing));
+    }
+
     CodeViewer* viewer = new CodeViewer(this);
     viewer->loadFile(path);
 
     int tabIndex = editorTabs_->addTab(viewer, QFileInfo(path).fileName());
     editorTabs_->setCurrentIndex(tabIndex);
+    return viewer;
+}
+
+void MainWindow::materializeEditorTab(int index)
+{
+    auto* pending = qobject_cast<PendingTab*>(editorTabs_->widget(index));
+    if (!pending)
+        return;
+
+    CodeViewer* viewer = new CodeViewer(this);
+    viewer->restoreViewState(pending->state());
+    PendingTab::replace(editorTabs_, index, viewer);
+}
+
+void MainWindow::createCodeViewerWindow()
+{
+    if (codeViewerWindow_)
+        return;
+
+    codeViewerWindow_ = new CodeViewerWindow(this);
+    connect(codeViewerWindow_, &QObject::destroyed, this, [this]() {
+        codeViewerWindow_ = nullptr;
+    });
+}
+
+void MainWindow::restoreSession()
+{
+    QSettings settings(QApplication::applicationName(), "Session");
+
+    if (PendingTab::restoreTabs(settings, "editorDock", editorTabs_) > 0) {
+        materializeEditorTab(editorTabs_->currentIndex());
+        editorDock_->show();
+    }
+
+    if (settings.value("codeViewerWindow/tabs/size", 0).toInt() > 0) {
+        createCodeViewerWindow();
+        if (codeViewerWindow_->restoreSession(settings, "codeViewerWindow"))
+            codeViewerWindow_->show();
+    }
+}
+
+void MainWindow::closeEvent(QCloseEvent* event)
+{
+    QSettings settings(QApplication::applicationName(), "Session");
+    PendingTab::saveTabs(settings, "editorDock", editorTabs_);
+
+    // A code viewer window the user closed is not brought back.
+    if (codeViewerWindow_ && codeViewerWindow_->isVisible())
+        codeViewerWindow_->saveSession(settings, "codeViewerWindow");
+    else
+        settings.remove("codeViewerWindow");
+
+    QMainWindow::closeEvent(event);
+}
+
+void MainWindow::recoverUnsavedEdits()
+{
+    const QVector<EditJournal::Recovery> recoveries = EditJournal::pendingRecoveries();
+    if (recoveries.isEmpty())
+        return;
+
+    QStringList names;
+    for (const auto& r : recoveries)
+        names << r.path;
+
+    const auto answer = QMessageBox::question(
+        this, "Recover unsaved changes",
+        QString("Unsaved changes from a previous session were found for:\n\n%1\n\n"
+                "Restore them?").arg(names.join("\n")));
+
+    QStringList skipped;
+    QStringList notEditable;
+    for (const auto& r : recoveries) {
+        if (answer != QMessageBox::Yes) {
+            EditJournal::removeJournal(r.journalFile);
+            continue;
+        }
+
+        // Edits only make sense on top of the exact file they were made to.
+        if (!EditJournal::baseMatches(r)) {
+            skipped << r.path;
+            EditJournal::removeJournal(r.journalFile);
+            continue;
+        }
+
+        if (!editorDock_->isVisible())
+            editorDock_->show();
+
+        CodeViewer* viewer = new CodeViewer(this);
+        if (!viewer->recoverFile(r.path, r.operations)) {
+            notEditable << r.path;
+            EditJournal::removeJournal(r.journalFile);
+            viewer->deleteLater();
+            continue;
+        }
+        viewer->setReadOnly(false);
+
+        int tabIndex = editorTabs_->addTab(viewer, QFileInfo(r.path).fileName() + " *");
+        editorTabs_->setCurrentIndex(tabIndex);
+    }
+
+    if (!skipped.isEmpty())
+        QMessageBox::warning(this, "Recover unsaved changes",
+                             QString("These files changed on disk since the edits were made "
+                                     "and were not restored:\n\n%1").arg(skipped.join("\n")));
+    if (!notEditable.isEmpty())
+        QMessageBox::warning(this, "Recover unsaved changes",
+                             QString("These files now open read-only or are already open, "
+                                     "so the edits were not restored:\n\n%1").arg(notEditable.join("\n")));
 }
 
 // void MainWindow::openSelected() {
@@ -558,7 +705,10 @@ void MainWindow::setupConnections() {
                 QFile f(path);
                 if (f.exists() && f.open(QIODevice::ReadOnly | QIODevice::Text)) {
                     auto data = f.read(64 * 1024); // limit preview size
-                    preview_->setPlainText(QString::fromUtf8(data));
+                    if (TextDecoder::looksBinary(data.constData(), data.size()))
+                        preview_->setPlainText(QString("Binary file, %1 bytes").arg(f.size()));
+                    else
+                        preview_->setPlainText(TextDecoder::decode(data));
                 } else {
                     preview_->clear();
                 }
@@ -779,18 +929,10 @@ void MainWindow::onContextMenuRequested(const QPoint& pos)
 
     connect(openCodeViewer, &QAction::triggered, this, [this, path]() {
 
-        if (path.endsWith(".cpp", Qt::CaseInsensitive) ||
-            path.endsWith(".h", Qt::CaseInsensitive) ||
+        if (Grammar::find(path) ||
             path.endsWith(".txt", Qt::CaseInsensitive)) { // .txt for testing purposes only
 
-            if (!codeViewerWindow_) {
-                codeViewerWindow_ = new CodeViewerWindow(this);
-
-                connect(codeViewerWindow_, &QObject::destroyed, this, [this]() {
-                    codeViewerWindow_ = nullptr;
-                });
-            }
-
+            createCodeViewerWindow();
             codeViewerWindow_->openFile(path);
             codeViewerWindow_->show();
             codeViewerWindow_->raise();
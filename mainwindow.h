@@ -29,6 +29,9 @@ public:
 
     void applyToolbarTheme(bool darkMode);
 
+protected:
+    void closeEvent(QCloseEvent* event) override;
+
 private:
     Ui::MainWindow *ui;
 
@@ -83,6 +86,11 @@ private:
     void updateAddressBar(const QString& dir);
     void updateNavButtons();
     void onContextMenuRequested(const QPoint& pos);
+    CodeViewer* openInEditorDock(const QString& path);
+    void recoverUnsavedEdits();
+    void createCodeViewerWindow();
+    void materializeEditorTab(int index);
+    void restoreSession();
 
 };
 #endif // MAINWINDOW_H
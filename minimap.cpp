@@ -4,6 +4,14 @@
 #include <QMouseEvent>
 #include <QTextDocument>
 #include <QTextBlock> // Ensure this is included
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Lines are this many character widths tall, two of them text, while the
+// document fits; then one row each, then two, four... lines per row.
+constexpr int kLineRows = 3;
+}
 
 MiniMap::MiniMap(QWidget* parent)
     : QWidget(parent)
@@ -16,12 +24,6 @@ void MiniMap::syncToEditor(QPlainTextEdit* editor)
 {
     editor_ = editor;
 
-    connect(editor_->document(), &QTextDocument::contentsChanged,
-            this, [this]() {
-                cacheDirty_ = true;
-                update();
-            });
-
     connect(editor_->verticalScrollBar(), &QScrollBar::valueChanged,
             this, [this](int value) {
                 updateVisibleRegion(value);
@@ -37,19 +39,76 @@ void MiniMap::syncToEditor(QPlainTextEdit* editor)
 void MiniMap::setHighlighter(codehighlighter* h)
 {
     highlighter_ = h;
-    cacheDirty_ = true;
+    // Lines drawn before the pass lexed them are Normal; the pass colours
+    // them block by block, and once it is done everything is drawn again.
+    disconnect(passConnection_);
+    if (highlighter_)
+        passConnection_ = connect(highlighter_, &codehighlighter::passFinished, this, &MiniMap::invalidate);
+    invalidate();
+}
+
+void MiniMap::setDocument(QTextDocument* document)
+{
+    disconnect(documentConnection_);
+    document_ = document;
+    if (document_)
+        documentConnection_ = connect(document_, &QTextDocument::contentsChange, this, &MiniMap::onContentsChange);
+    invalidate();
+}
+
+void MiniMap::setBuffer(const TextBuffer* buffer)
+{
+    buffer_ = buffer;
+    invalidate();
+}
+
+void MiniMap::setSharedCache(MiniMapCache* cache)
+{
+    shared_ = cache;
+    update();
+}
+
+int MiniMap::lineCount() const
+{
+    if (buffer_)
+        return buffer_->lineCount();
+    return document_ ? document_->blockCount() : 0;
+}
+
+void MiniMap::markDirty(int first, int last)
+{
+    MiniMapCache* c = cache();
+    c->dirtyFirst = qMin(c->dirtyFirst, first);
+    c->dirtyLast = qMax(c->dirtyLast, last);
     update();
 }
 
+void MiniMap::invalidate()
+{
+    markDirty(0, INT_MAX);
+}
+
+void MiniMap::onContentsChange(int position, int removed, int added)
+{
+    // Text and formats (the highlighter colouring a block) alike. Lines
+    // inserted or removed move every line below.
+    const int first = document_->findBlock(position).blockNumber();
+    if (document_->blockCount() != cache()->lineCount)
+        markDirty(first, INT_MAX);
+    else
+        markDirty(first, document_->findBlock(position + qMax(added, removed)).blockNumber() + 1);
+}
+
 void MiniMap::paintEvent(QPaintEvent*)
 {
     if (!editor_) return;
 
-    if (cacheDirty_)
-        rebuildCache();
+    // Another view of the document may have left the shared image at its
+    // own size; otherwise this only draws what changed.
+    updateCache();
 
     QPainter p(this);
-    p.drawPixmap(0, 0, cache_);
+    p.drawImage(0, 0, cache()->image);
 
     if (visibleRect_.isValid())
     {
@@ -79,21 +138,22 @@ void MiniMap::updateVisibleRegion(int scroll)
     double totalRange = double(max - min) + pageStep;
     double visibleRatio = pageStep / totalRange;
 
-    int h = int(visibleRatio * height());
+    const int content = contentHeight();
+    int h = int(visibleRatio * content);
 
     if (h < 1) h = 1;
-    if (h > height()) h = height();
+    if (h > content) h = content;
 
     double scrollRatio = double(scroll - min) / double(max - min);
 
     if (scrollRatio < 0.0) scrollRatio = 0.0;
     if (scrollRatio > 1.0) scrollRatio = 1.0;
 
-    int y = int(scrollRatio * (height() - h));
+    int y = int(scrollRatio * (content - h));
 
     if (y < 0) y = 0;
 
-    if (y + h > height()) y = height() - h;
+    if (y + h > content) y = content - h;
 
     visibleRect_ = QRect(0, y, width(), h);
     update();
@@ -109,15 +169,7 @@ void MiniMap::mousePressEvent(QMouseEvent* e)
         return;
     }
 
-    QFont f("Consolas");
-    f.setPixelSize(5);
-    QFontMetrics fm(f);
-    int miniLineHeight = fm.height();
-    int totalLines = editor_->document()->blockCount();
-    if (totalLines <= 0) return;
-    int virtualHeight = totalLines * miniLineHeight;
-
-    double ratio = e->pos().y() / double(height());
+    double ratio = e->pos().y() / double(contentHeight());
 
     if (ratio < 0.0) ratio = 0.0;
     if (ratio > 1.0) ratio = 1.0;
@@ -135,13 +187,14 @@ void MiniMap::mouseMoveEvent(QMouseEvent* e)
 {
     if (!editor_ || !dragging_) return;
 
+    const int range = qMax(1, contentHeight() - visibleRect_.height());
     int newY = e->pos().y() - dragOffsetY_;
     if (newY < 0) newY = 0;
 
-    if (newY > height() - visibleRect_.height())
-        newY = height() - visibleRect_.height();
+    if (newY > range)
+        newY = range;
 
-    double ratio = double(newY) / double(height() - visibleRect_.height());
+    double ratio = double(newY) / double(range);
 
     if (ratio < 0.0) ratio = 0.0;
     if (ratio > 1.0) ratio = 1.0; // The ratio must stop at 1.0 when the rect hits the bottom
@@ -159,73 +212,201 @@ void MiniMap::mouseReleaseEvent(QMouseEvent*)
     dragging_ = false;
 }
 
-// *** CRITICAL FIX: Uses QTextBlock iterator for drawing ***
-void MiniMap::rebuildCache()
+int MiniMap::contentHeight() const
 {
-    if (!editor_) return;
+    const MiniMapCache* c = cache();
+    if (c->image.isNull() || c->lineCount <= 0)
+        return qMax(1, height());
+    const int rows = c->rowsPerLine > 1 ? c->lineCount * c->rowsPerLine
+                                        : (c->lineCount + c->linesPerRow - 1) / c->linesPerRow;
+    return qBound(1, int(rows / c->image.devicePixelRatio()), height());
+}
+
+// Each character is a pixel wide per device pixel ratio, written straight
+// into the scanlines of the image. Lines that share a row are blended by
+// how many of them have text in each column, so long files keep their
+// shape without drawing any text.
+void MiniMap::updateCache()
+{
+    MiniMapCache* c = cache();
+    const qreal dpr = devicePixelRatioF();
+    const QSize pixels = (QSizeF(size()) * dpr).toSize();
+    const int totalLines = lineCount();
+
+    if (totalLines <= 0 || pixels.isEmpty()) {
+        c->image = QImage();
+        c->lineCount = 0;
+        c->dirtyFirst = INT_MAX;
+        c->dirtyLast = 0;
+        return;
+    }
 
-    QFont f("Consolas");
-    f.setPixelSize(5);
-    QFontMetrics fm(f);
-    int miniLineHeight = fm.height();
+    // Pitch for this many lines; the power-of-two steps keep it for most
+    // line counts.
+    const int charWidth = qMax(1, qRound(dpr));
+    int rowsPerLine = 1;
+    int linesPerRow = 1;
+    if (qint64(totalLines) * kLineRows * charWidth <= pixels.height()) {
+        rowsPerLine = kLineRows * charWidth;
+    } else {
+        while ((qint64(totalLines) + linesPerRow - 1) / linesPerRow > pixels.height())
+            linesPerRow *= 2;
+    }
 
-    int totalLines = editor_->document()->blockCount();
-    int virtualHeight = totalLines * miniLineHeight;
+    const QRgb bg = parentWidget()->palette().color(QPalette::Window).rgb();
+    int first = qMax(0, c->dirtyFirst);
+    int last = qMin(totalLines, c->dirtyLast);
+    if (c->image.size() != pixels || c->background != bg
+        || c->rowsPerLine != rowsPerLine || c->linesPerRow != linesPerRow) {
+        c->image = QImage(pixels, QImage::Format_RGB32);
+        c->image.setDevicePixelRatio(dpr);
+        c->image.fill(bg);
+        c->rowsPerLine = rowsPerLine;
+        c->linesPerRow = linesPerRow;
+        c->background = bg;
+        first = 0;
+        last = totalLines;
+    } else if (c->lineCount != totalLines) {
+        last = totalLines;   // lines below the change have moved
+    }
 
-    if (virtualHeight <= 0) {
-        cache_ = QPixmap(size());
-        cache_.fill(Qt::transparent);
-        cacheDirty_ = false;
+    if (first >= last && c->lineCount == totalLines) {
+        c->dirtyFirst = INT_MAX;
+        c->dirtyLast = 0;
         return;
     }
 
-    QPixmap big(width(), virtualHeight);
-    big.setDevicePixelRatio(this->devicePixelRatioF());
-    big.fill(Qt::transparent);
-
-    QPainter p(&big);
-    QColor bg = parentWidget()->palette().color(QPalette::Window);
-    p.fillRect(big.rect(), bg);
+    // Whole rows: every line sharing a row with a dirty one is drawn
+    // again, and when lines came or went, everything below is cleared.
+    first = qMin(first, totalLines) / linesPerRow * linesPerRow;
+    last = qMin(totalLines, (last + linesPerRow - 1) / linesPerRow * linesPerRow);
+    const int top = rowsPerLine > 1 ? first * rowsPerLine : first / linesPerRow;
+    int bottom = rowsPerLine > 1 ? last * rowsPerLine : (last + linesPerRow - 1) / linesPerRow;
+    if (c->lineCount != totalLines)
+        bottom = pixels.height();
+    for (int y = top; y < qMin(bottom, pixels.height()); ++y)
+        std::fill_n(reinterpret_cast<QRgb*>(c->image.scanLine(y)), pixels.width(), bg);
+    c->lineCount = totalLines;
+    if (first < last)
+        drawLines(c, first, last);
+    c->dirtyFirst = INT_MAX;
+    c->dirtyLast = 0;
+
+    QScrollBar* sb = editor_ ? editor_->verticalScrollBar() : nullptr;
+    if (sb)
+        updateVisibleRegion(sb->value());
+}
 
-    p.setFont(f);
-    p.setOpacity(0.7);
+void MiniMap::drawLines(MiniMapCache* c, int first, int last)
+{
+    QImage& image = c->image;
+    const QRgb bg = c->background;
+
+    QRgb colors[kTokenClassCount];
+    for (int cls = 0; cls < kTokenClassCount; ++cls) {
+        colors[cls] = !highlighter_ ? qRgb(200, 200, 200)
+            : cls == int(TokenClass::Normal) ? qRgb(128, 128, 128)
+            : highlighter_->color(TokenClass(cls)).rgb();
+    }
 
-    QTextBlock block = editor_->document()->begin();
-    int y = 0;
-    while (block.isValid())
-    {
-        const QString line = block.text();
-        int x = 2;
-
-        if (highlighter_) {
-            auto tokens = highlighter_->highlightLine(line);
-            for (const MiniToken& t : tokens) {
-                p.setPen(t.color);
-                p.drawText(x, y, t.text);
-                x += p.fontMetrics().horizontalAdvance(t.text);
+    // Colour sums and the number of lines with text per column, for the
+    // lines of the current row (or the one line of the current rows).
+    const int imageWidth = image.width();
+    const int charWidth = qMax(1, qRound(image.devicePixelRatio()));
+    const int left = 2 * charWidth;
+    const int columns = (imageWidth - left) / charWidth;
+    // A row can stand for any number of lines, so nothing here is narrower
+    // than the line count.
+    QVector<quint64> red(imageWidth), green(imageWidth), blue(imageWidth);
+    QVector<quint32> hits(imageWidth);
+    int groupTop = -1;
+    int groupLines = 0;
+
+    const int bgRed = qRed(bg), bgGreen = qGreen(bg), bgBlue = qBlue(bg);
+    auto flush = [&]() {
+        if (groupLines == 0)
+            return;
+        // Tall lines leave a gap below, like text.
+        const int textRows = c->rowsPerLine > 1 ? c->rowsPerLine * 2 / 3 : 1;
+        QRgb* row = reinterpret_cast<QRgb*>(image.scanLine(groupTop));
+        for (int x = 0; x < imageWidth; ++x) {
+            if (!hits[x])
+                continue;
+            // 70% opaque where every line of the group has text.
+            const int alpha = int(qMin<qint64>(179, 179 * 2 * qint64(hits[x]) / groupLines));
+            const quint32 n = hits[x];
+            row[x] = qRgb(bgRed + (int(red[x] / n) - bgRed) * alpha / 256,
+                          bgGreen + (int(green[x] / n) - bgGreen) * alpha / 256,
+                          bgBlue + (int(blue[x] / n) - bgBlue) * alpha / 256);
+            red[x] = green[x] = blue[x] = 0;
+            hits[x] = 0;
+        }
+        for (int y = groupTop + 1; y < groupTop + textRows && y < image.height(); ++y)
+            std::memcpy(image.scanLine(y), row, imageWidth * sizeof(QRgb));
+        groupLines = 0;
+    };
+
+    // Tokens come from the highlighter's per-block cache. Blocks it has
+    // not lexed yet are drawn as Normal; colouring them changes their
+    // formats, which marks them to be drawn again.
+    auto drawLine = [&](int line, QStringView view, const QTextBlock& block) {
+        const int top = c->rowsPerLine > 1 ? line * c->rowsPerLine : line / c->linesPerRow;
+        if (top >= image.height())
+            return false;
+        if (top != groupTop) {
+            flush();
+            groupTop = top;
+        }
+        ++groupLines;
+
+        const QVector<Token>* cached = highlighter_ && block.isValid() ? codehighlighter::cachedTokens(block) : nullptr;
+        const TokenSpan tokens = cached ? TokenSpan(*cached) : TokenSpan();
+
+        int column = 0;
+        forEachRun(tokens, int(view.size()), [&](int start, int length, TokenClass cls) {
+            // Tokens of an edited line may be stale until it is lexed again.
+            const QRgb color = colors[int(cls)];
+            const int end = qMin(start + length, int(view.size()));
+            for (int i = start; i < end && column < columns; ++i) {
+                const char16_t ch = view[i].unicode();
+                if (ch == '\t') {
+                    column = (column / 4 + 1) * 4;
+                    continue;
+                }
+                if (ch != ' ') {
+                    for (int x = left + column * charWidth, end = x + charWidth; x < end; ++x) {
+                        red[x] += qRed(color);
+                        green[x] += qGreen(color);
+                        blue[x] += qBlue(color);
+                        ++hits[x];
+                    }
+                }
+                ++column;
             }
-        } else {
-            p.setPen(QColor(200, 200, 200));
-            p.drawText(2, y, line);
+        });
+        return true;
+    };
+
+    QTextBlock block = document_ ? document_->findBlockByNumber(first) : QTextBlock();
+    if (buffer_) {
+        buffer_->snapshot().forEachLine(first, [&](int line, QStringView view) {
+            if (line >= last || !drawLine(line, view, block))
+                return false;
+            block = block.next();
+            return true;
+        });
+    } else {
+        for (int line = first; line < last && block.isValid(); block = block.next(), ++line) {
+            if (!drawLine(line, block.text(), block))
+                break;
         }
-
-        y += miniLineHeight;
-        block = block.next();
     }
-
-    cache_ = big.scaled(width(), height(),
-                        Qt::IgnoreAspectRatio,
-                        Qt::SmoothTransformation);
-
-    cacheDirty_ = false;
-
-    QScrollBar* sb = editor_->verticalScrollBar();
-    updateVisibleRegion(sb->value());
+    flush();
 }
 
 void MiniMap::resizeEvent(QResizeEvent*)
 {
-    cacheDirty_ = true;
+    invalidate();
 
     if (editor_) {
         QScrollBar* sb = editor_->verticalScrollBar();
@@ -1,7 +1,27 @@
 #pragma once
 #include <QWidget>
+#include <QImage>
 #include <QPlainTextEdit>
+#include <QPointer>
+#include <climits>
 #include "codehighlighter.h"
+#include "textbuffer.h"
+
+// Rendering of one document in device pixels, shared by the minimaps of
+// every view on it that has the same size. Lines are laid out at a fixed
+// pitch (a few rows per line, or a power of two lines per row), so edits
+// and appends only redraw the rows of the lines they touch; the layout,
+// and with it the whole image, only changes when the line count crosses
+// a power of two.
+struct MiniMapCache {
+    QImage image;
+    int lineCount = 0;     // lines the image holds
+    int rowsPerLine = 1;
+    int linesPerRow = 1;
+    QRgb background = 0;
+    int dirtyFirst = 0;    // lines [dirtyFirst, dirtyLast) to draw again
+    int dirtyLast = INT_MAX;
+};
 
 class MiniMap : public QWidget
 {
@@ -12,7 +32,15 @@ public:
     void syncToEditor(QPlainTextEdit* editor);
     void updateVisibleRegion(int scroll);
     void setHighlighter(codehighlighter* h);
-    void rebuildCache();
+    // The document shown; its changes mark the lines to draw again.
+    void setDocument(QTextDocument* document);
+    // Lines are read from the buffer's snapshot instead of QTextBlocks.
+    void setBuffer(const TextBuffer* buffer);
+    void setSharedCache(MiniMapCache* cache);
+    // Draws the lines marked since the last call.
+    void updateCache();
+    // Marks every line.
+    void invalidate();
 
 protected:
     void paintEvent(QPaintEvent* event) override;
@@ -22,13 +50,25 @@ protected:
     void mouseReleaseEvent(QMouseEvent*) override;
 
 private:
+    MiniMapCache* cache() { return shared_ ? shared_ : &own_; }
+    const MiniMapCache* cache() const { return shared_ ? shared_ : &own_; }
+    int lineCount() const;
+    void markDirty(int first, int last);
+    void onContentsChange(int position, int removed, int added);
+    void drawLines(MiniMapCache* c, int first, int last);
+    // Height in widget pixels of the rows that hold lines.
+    int contentHeight() const;
+
     QPlainTextEdit* editor_ = nullptr;
     QRect visibleRect_;
     bool dragging_ = false;
     int dragOffsetY_ = 0;
 
     codehighlighter* highlighter_ = nullptr;
-
-    QPixmap cache_;
-    bool cacheDirty_ = true;
+    QPointer<QTextDocument> document_;
+    QMetaObject::Connection documentConnection_;
+    QMetaObject::Connection passConnection_;
+    const TextBuffer* buffer_ = nullptr;
+    MiniMapCache* shared_ = nullptr;
+    MiniMapCache own_;
 };
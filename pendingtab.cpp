@@ -0,0 +1,121 @@
+#include "pendingtab.h"
+
+#include <QFileInfo>
+#include <QHash>
+#include <QSettings>
+#include <QTabWidget>
+
+PendingTab::PendingTab(const CodeViewer::ViewState& state, QWidget* parent)
+    : QWidget(parent), state_(state)
+{}
+
+QString PendingTab::tabPath(const QWidget* tab)
+{
+    if (auto* viewer = qobject_cast<const CodeViewer*>(tab))
+        return viewer->filePath();
+    if (auto* pending = qobject_cast<const PendingTab*>(tab))
+        return pending->state().path;
+    return QString();
+}
+
+int PendingTab::indexOf(const QTabWidget* tabs, const QString& path)
+{
+    const QString canonical = QFileInfo(path).canonicalFilePath();
+    for (int i = 0; i < tabs->count() && !canonical.isEmpty(); ++i) {
+        if (QFileInfo(tabPath(tabs->widget(i))).canonicalFilePath() == canonical)
+            return i;
+    }
+    return -1;
+}
+
+void PendingTab::saveTabs(QSettings& settings, const QString& group, const QTabWidget* tabs)
+{
+    settings.remove(group);
+    settings.beginGroup(group);
+
+    int current = -1;
+    int saved = 0;
+    settings.beginWriteArray("tabs");
+    for (int i = 0; i < tabs->count(); ++i) {
+        CodeViewer::ViewState state;
+        if (auto* viewer = qobject_cast<const CodeViewer*>(tabs->widget(i)))
+            state = viewer->viewState();
+        else if (auto* pending = qobject_cast<const PendingTab*>(tabs->widget(i)))
+            state = pending->state();
+        if (state.path.isEmpty())
+            continue;
+
+        if (i == tabs->currentIndex())
+            current = saved;
+        settings.setArrayIndex(saved++);
+        settings.setValue("path", state.path);
+        settings.setValue("cursor", state.cursor);
+        settings.setValue("topLine", state.topLine);
+        settings.setValue("readOnly", state.readOnly);
+    }
+    settings.endArray();
+
+    settings.setValue("current", current);
+    settings.endGroup();
+}
+
+int PendingTab::restoreTabs(QSettings& settings, const QString& group, QTabWidget* tabs)
+{
+    // Files already open (recovered edits, say) keep their tab. Only these
+    // few are compared, so the cost stays linear in the saved tabs.
+    QHash<QString, int> open;
+    for (int i = 0; i < tabs->count(); ++i)
+        open.insert(QFileInfo(tabPath(tabs->widget(i))).canonicalFilePath(), i);
+
+    settings.beginGroup(group);
+    const int savedCurrent = settings.value("current", -1).toInt();
+    const int count = settings.beginReadArray("tabs");
+
+    // Adding the first tab would make it current and get it loaded.
+    QSignalBlocker block(tabs);
+    int current = -1;
+    int added = 0;
+    for (int i = 0; i < count; ++i) {
+        settings.setArrayIndex(i);
+        CodeViewer::ViewState state;
+        state.path = settings.value("path").toString();
+        state.cursor = settings.value("cursor", 0).toLongLong();
+        state.topLine = settings.value("topLine", 0).toLongLong();
+        state.readOnly = settings.value("readOnly", true).toBool();
+
+        const QFileInfo info(state.path);
+        if (!info.isFile())
+            continue;
+
+        int index = open.value(info.canonicalFilePath(), -1);
+        if (index < 0) {
+            index = tabs->addTab(new PendingTab(state), info.fileName());
+            ++added;
+        }
+        if (i == savedCurrent)
+            current = index;
+    }
+    settings.endArray();
+    settings.endGroup();
+
+    block.unblock();
+    if (current >= 0)
+        tabs->setCurrentIndex(current);
+    return added;
+}
+
+void PendingTab::replace(QTabWidget* tabs, int index, CodeViewer* viewer)
+{
+    QWidget* pending = tabs->widget(index);
+    const bool current = tabs->currentIndex() == index;
+
+    // Removing the placeholder would briefly make a neighbour current.
+    QSignalBlocker block(tabs);
+    tabs->insertTab(index, viewer, tabs->tabText(index));
+    tabs->removeTab(index + 1);
+    block.unblock();
+
+    if (current)
+        tabs->setCurrentIndex(index);
+    pending->deleteLater();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <QWidget>
+#include "codeviewer.h"
+
+class QSettings;
+class QTabWidget;
+
+// Stand-in for a tab restored from the last session. It only remembers
+// where the viewer was; the owner of the tab widget swaps in a real
+// CodeViewer the first time the tab becomes current, so restoring 40 tabs
+// costs about as much as restoring one.
+class PendingTab : public QWidget {
+    Q_OBJECT
+public:
+    explicit PendingTab(const CodeViewer::ViewState& state, QWidget* parent = nullptr);
+
+    const CodeViewer::ViewState& state() const { return state_; }
+
+    // File shown by a CodeViewer or PendingTab; empty for other widgets.
+    static QString tabPath(const QWidget* tab);
+    // Tab showing the same file as path, or -1.
+    static int indexOf(const QTabWidget* tabs, const QString& path);
+
+    // Writes the files of all tabs and the current tab under group.
+    static void saveTabs(QSettings& settings, const QString& group, const QTabWidget* tabs);
+    // Adds a PendingTab for every saved file that still exists and has no
+    // tab yet, then makes the saved current tab current. Returns the
+    // number of tabs added.
+    static int restoreTabs(QSettings& settings, const QString& group, QTabWidget* tabs);
+    // Puts viewer in place of the PendingTab at index and deletes it.
+    static void replace(QTabWidget* tabs, int index, CodeViewer* viewer);
+
+private:
+    CodeViewer::ViewState state_;
+};
@@ -0,0 +1,304 @@
+#include "shareddocument.h"
+#include "codehighlighter.h"
+#include "editjournal.h"
+#include "grammar.h"
+#include "highlightcache.h"
+
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QPlainTextDocumentLayout>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QThread>
+#include <QTimer>
+
+// Writers often touch a file several times in a row; wait for the last.
+static constexpr int kReloadDelayMs = 200;
+// A file replaced by rename may take a moment to reappear.
+static constexpr int kReloadRetryMs = 1000;
+
+SharedDocument::SharedDocument()
+    : document_(new QTextDocument(this))
+{
+    // QPlainTextEdit::setDocument() requires the plain text layout.
+    document_->setDocumentLayout(new QPlainTextDocumentLayout(document_));
+    highlighter_ = new codehighlighter(document_, false);
+    highlighter_->setBuffer(&buffer_);
+
+    connect(document_, &QTextDocument::contentsChange,
+            this, &SharedDocument::onContentsChange);
+    connect(highlighter_, &codehighlighter::passFinished,
+            this, &SharedDocument::storeHighlightCache);
+
+    reloadTimer_ = new QTimer(this);
+    reloadTimer_->setSingleShot(true);
+    connect(reloadTimer_, &QTimer::timeout, this, &SharedDocument::checkForChanges);
+}
+
+SharedDocument::~SharedDocument()
+{
+    stopReload();
+
+    // A journal with unsaved edits is kept for recovery on the next start.
+    if (journal_ && !document_->isModified())
+        journal_->discard();
+}
+
+void SharedDocument::setJournal(EditJournal* journal)
+{
+    delete journal_;
+    journal_ = journal;
+    if (journal_)
+        journal_->setParent(this);
+}
+
+TextSnapshot SharedDocument::documentText() const
+{
+    // toPlainText() would also turn non-breaking spaces into spaces.
+    TextBuffer text;
+    text.setText(document_->toRawText().replace(QChar::ParagraphSeparator, QLatin1Char('\n')));
+    return text.snapshot();
+}
+
+void SharedDocument::onContentsChange(int position, int removed, int added)
+{
+    const int length = document_->characterCount() - 1;
+
+    QString text;
+    if (added > 0) {
+        // Same clamping as the journal: the final paragraph separator is
+        // counted by Qt but is not part of the text.
+        QTextCursor c(document_);
+        c.setPosition(position);
+        c.setPosition(qMin(position + added, length), QTextCursor::KeepAnchor);
+        text = c.selectedText();
+        text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    }
+
+    // Format-only changes report the same text as removed and added; keep
+    // the buffer, and so the identity of its snapshots, untouched, and
+    // keep them out of the journal.
+    if (removed == added && buffer_.length() == length
+        && buffer_.snapshot().text(position, text.size()) == text)
+        return;
+
+    if (journal_)
+        journal_->record(position, removed, text);
+
+    // Qt sometimes reports a removal that includes the final separator,
+    // which the buffer does not hold; remove() clamps it.
+    buffer_.remove(position, removed);
+    if (!text.isEmpty())
+        buffer_.insert(position, text);
+
+    // Should the two still disagree, the text after the change is copied
+    // again rather than the whole document.
+    if (buffer_.length() != length) {
+        const qint64 end = position + text.size();
+        buffer_.remove(end, buffer_.length());
+        QTextCursor c(document_);
+        c.setPosition(qMin<int>(end, length));
+        c.setPosition(length, QTextCursor::KeepAnchor);
+        buffer_.insert(buffer_.length(), c.selectedText().replace(QChar::ParagraphSeparator, QLatin1Char('\n')));
+    }
+}
+
+void SharedDocument::storeHighlightCache()
+{
+    // Only the file as it is on disk is worth keeping.
+    if (path_.isEmpty() || !shareable_ || document_->isModified()
+        || QFileInfo(path_).size() < HighlightCache::kMinFileSize)
+        return;
+
+    HighlightCache::Entry entry;
+    entry.grammar = highlighter_->grammar()->name();
+    LexedLines& lines = entry.lines;
+    lines.states.reserve(document_->blockCount());
+    lines.tokenEnds.reserve(document_->blockCount());
+    for (QTextBlock block = document_->begin(); block.isValid(); block = block.next()) {
+        const QVector<Token>* tokens = codehighlighter::cachedTokens(block);
+        if (!tokens)
+            return;
+        lines.tokens += *tokens;
+        lines.tokenEnds.append(int(lines.tokens.size()));
+        lines.states.append(block.userState());
+    }
+    HighlightCache::store(path_, buffer_.snapshot(), entry);
+}
+
+void SharedDocument::setPath(const QString& path)
+{
+    stopReload();
+    path_ = path;
+    savedSize_ = -1;
+    highlighter_->setGrammar(Grammar::forPath(path));
+
+    delete watcher_;
+    watcher_ = new QFileSystemWatcher(QStringList{ path }, this);
+    connect(watcher_, &QFileSystemWatcher::fileChanged, this, [this]() {
+        reloadTimer_->start(kReloadDelayMs);
+    });
+}
+
+void SharedDocument::markSaved()
+{
+    const QFileInfo info(path_);
+    savedSize_ = info.size();
+    savedModified_ = info.lastModified();
+}
+
+void SharedDocument::checkForChanges()
+{
+    // Saving by rename drops the path from the watcher.
+    if (!watcher_->files().contains(path_)) {
+        if (!QFileInfo::exists(path_)) {
+            reloadTimer_->start(kReloadRetryMs);
+            return;
+        }
+        watcher_->addPath(path_);
+    }
+
+    // Unsaved edits win; so do documents still loading or being followed.
+    if (!shareable_ || document_->isModified())
+        return;
+
+    // Our own save: the file already holds the document.
+    const QFileInfo info(path_);
+    if (info.size() == savedSize_ && info.lastModified() == savedModified_)
+        return;
+    startReload();
+}
+
+void SharedDocument::startReload()
+{
+    stopReload();
+
+    auto* thread = new QThread;
+    auto* differ = new ReloadDiffer(path_, buffer_.snapshot(), format_);
+    differ->moveToThread(thread);
+
+    connect(thread, &QThread::started, differ, &ReloadDiffer::run);
+    connect(differ, &ReloadDiffer::finished, thread, &QThread::quit, Qt::DirectConnection);
+    connect(thread, &QThread::finished, differ, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    // A result for an older request, or for a document that has been
+    // edited since the snapshot, is dropped.
+    const int id = ++reloadId_;
+    reloadRevision_ = document_->revision();
+    connect(differ, &ReloadDiffer::finished, this,
+            [this, id](bool ok, const QVector<LineDiff::Hunk>& hunks) {
+        if (id != reloadId_)
+            return;
+        reloadThread_ = nullptr;
+        if (ok && !hunks.isEmpty() && shareable_ && !document_->isModified()
+            && document_->revision() == reloadRevision_)
+            applyHunks(hunks);
+    });
+
+    reloadThread_ = thread;
+    thread->start();
+}
+
+void SharedDocument::stopReload()
+{
+    if (!reloadThread_)
+        return;
+
+    // The diff cannot be interrupted, but it only reads.
+    reloadThread_->quit();
+    reloadThread_->wait();
+    ++reloadId_;
+    reloadThread_ = nullptr;
+}
+
+void SharedDocument::applyHunks(const QVector<LineDiff::Hunk>& hunks)
+{
+    // The journal is relative to the file on disk, which now matches again.
+    const bool journaled = journal_ != nullptr;
+    if (journaled) {
+        journal_->discard();
+        setJournal(nullptr);
+    }
+
+    // Bottom up, so the line numbers of the hunks above stay valid.
+    QTextCursor cursor(document_);
+    cursor.beginEditBlock();
+    for (auto it = hunks.crbegin(); it != hunks.crend(); ++it) {
+        const int blocks = document_->blockCount();
+        const int end = it->oldStart + it->oldCount;
+        QString text = it->lines.join(QLatin1Char('\n'));
+
+        if (end < blocks) {
+            // Whole lines, each with its line break.
+            cursor.setPosition(document_->findBlockByNumber(it->oldStart).position());
+            cursor.setPosition(document_->findBlockByNumber(end).position(), QTextCursor::KeepAnchor);
+            if (!it->lines.isEmpty())
+                text += QLatin1Char('\n');
+        } else if (it->oldStart >= blocks) {
+            // Lines added after the last one.
+            cursor.movePosition(QTextCursor::End);
+            text.prepend(QLatin1Char('\n'));
+        } else {
+            // Up to the end. Removing the last lines takes the line break
+            // before them as well.
+            int start = document_->findBlockByNumber(it->oldStart).position();
+            if (it->lines.isEmpty() && start > 0)
+                --start;
+            cursor.setPosition(start);
+            cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+        }
+
+        if (text.isEmpty())
+            cursor.removeSelectedText();
+        else
+            cursor.insertText(text);
+    }
+    cursor.endEditBlock();
+    document_->setModified(false);
+
+    if (journaled) {
+        setJournal(new EditJournal(path_));
+        journal_->start();
+    }
+}
+
+QHash<QString, std::weak_ptr<SharedDocument>>& DocumentRegistry::documents()
+{
+    static QHash<QString, std::weak_ptr<SharedDocument>> documents;
+    return documents;
+}
+
+std::shared_ptr<SharedDocument> DocumentRegistry::find(const QString& path)
+{
+    const QString key = QFileInfo(path).canonicalFilePath();
+    if (key.isEmpty())
+        return nullptr;
+
+    auto& docs = documents();
+    const auto it = docs.find(key);
+    if (it == docs.end())
+        return nullptr;
+
+    std::shared_ptr<SharedDocument> doc = it->lock();
+    if (!doc) {
+        docs.erase(it);
+        return nullptr;
+    }
+    return doc->isShareable() ? doc : nullptr;
+}
+
+void DocumentRegistry::add(const QString& path, const std::shared_ptr<SharedDocument>& doc)
+{
+    const QString key = QFileInfo(path).canonicalFilePath();
+    if (key.isEmpty() || !doc)
+        return;
+
+    // A document that cannot be shared (still loading, followed, ...)
+    // gives way to the newer one.
+    std::weak_ptr<SharedDocument>& entry = documents()[key];
+    const std::shared_ptr<SharedDocument> current = entry.lock();
+    if (!current || !current->isShareable())
+        entry = doc;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QPointer>
+#include <QString>
+#include <memory>
+#include "linediff.h"
+#include "minimap.h"
+#include "textbuffer.h"
+#include "textdecoder.h"
+
+class QTextDocument;
+class QFileSystemWatcher;
+class QThread;
+class QTimer;
+class codehighlighter;
+class EditJournal;
+
+// One open file as seen by every CodeViewer showing it: the QTextDocument
+// with its highlighter, the TextBuffer mirror, the crash journal and the
+// minimap rendering. The QTextDocument is the source of truth; the mirror
+// is a second copy of the text, so editable files are held twice. It only
+// feeds readers that can live with a stale line (highlighting workers, the
+// minimap, reload diffs); saving reads the QTextDocument. Files too large
+// to hold twice go to the read-only LargeFileView instead. Views hold it
+// through a shared_ptr; the last one to let go frees it.
+//
+// Once it has a path, the file is watched. When something else rewrites
+// it (a build, git checkout) and the document has no unsaved edits, the
+// new contents are diffed against a snapshot on a worker and only the
+// changed lines are replaced, in one undoable edit block, so the views
+// keep their scroll position and only those blocks are rehighlighted.
+class SharedDocument : public QObject {
+    Q_OBJECT
+public:
+    SharedDocument();
+    ~SharedDocument() override;
+
+    QTextDocument* document() const { return document_; }
+    codehighlighter* highlighter() const { return highlighter_; }
+    const TextBuffer& buffer() const { return buffer_; }
+    // The document's own text, copied in one pass; this is what is saved.
+    TextSnapshot documentText() const;
+    MiniMapCache* miniMapCache() { return &miniMapCache_; }
+
+    // Takes ownership; replaces (and deletes) the previous journal.
+    void setJournal(EditJournal* journal);
+    EditJournal* journal() const { return journal_; }
+
+    // The file the document was loaded from; starts watching it and picks
+    // the highlighter's grammar from its extension.
+    void setPath(const QString& path);
+    QString path() const { return path_; }
+
+    // Encoding and line ending of the file, written back on save.
+    void setFormat(const TextFormat& format) { format_ = format; }
+    TextFormat format() const { return format_; }
+
+    // Remembers the file as a save left it, so the watcher event the save
+    // itself causes does not read and diff the whole file again.
+    void markSaved();
+
+    // Only fully loaded, plain text documents are handed to other views;
+    // the view that loads the file decides.
+    void setShareable(bool shareable) { shareable_ = shareable; }
+    bool isShareable() const { return shareable_; }
+
+private:
+    void onContentsChange(int position, int removed, int added);
+    void storeHighlightCache();
+    void checkForChanges();
+    void startReload();
+    void stopReload();
+    void applyHunks(const QVector<LineDiff::Hunk>& hunks);
+
+    QTextDocument* document_;
+    codehighlighter* highlighter_;
+    TextBuffer buffer_;   // mirrors document_, see onContentsChange()
+    EditJournal* journal_ = nullptr;
+    MiniMapCache miniMapCache_;
+    bool shareable_ = false;
+
+    QString path_;
+    TextFormat format_;
+    QFileSystemWatcher* watcher_ = nullptr;
+    QTimer* reloadTimer_;
+    QPointer<QThread> reloadThread_;
+    int reloadId_ = 0;
+    int reloadRevision_ = -1;   // document revision the running diff is against
+    qint64 savedSize_ = -1;     // the file as our last save left it
+    QDateTime savedModified_;
+};
+
+// Process-wide map from canonical file path to the document open on it,
+// so a file opened in the editor dock and in a CodeViewerWindow (or twice
+// in either) is loaded, highlighted and journaled once. Entries do not
+// keep documents alive. GUI thread only.
+class DocumentRegistry {
+public:
+    // The shareable document open on path, if any.
+    static std::shared_ptr<SharedDocument> find(const QString& path);
+    // Registers doc for path unless a shareable document already is.
+    static void add(const QString& path, const std::shared_ptr<SharedDocument>& doc);
+
+private:
+    static QHash<QString, std::weak_ptr<SharedDocument>>& documents();
+};
@@ -0,0 +1,32 @@
+#include "simd.h"
+
+#ifdef FILEEXPLORER_SSE2
+namespace {
+bool detectAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+}
+
+bool cpuHasAvx2()
+{
+    static const bool has = detectAvx2();
+    return has;
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+#include <QtGlobal>
+
+// Shared bits for the hand-vectorized scanners (text decoding, line
+// indexing). SSE2 is the x86-64 baseline; AVX2 kernels are compiled with
+// a target attribute and only called when cpuHasAvx2() says so.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define FILEEXPLORER_SSE2
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define FILEEXPLORER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define FILEEXPLORER_TARGET_AVX2
+#endif
+
+#ifdef FILEEXPLORER_SSE2
+inline int countTrailingZeros(quint32 v)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return int(index);
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+// Cached after the first call.
+bool cpuHasAvx2();
+#endif
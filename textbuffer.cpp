@@ -0,0 +1,343 @@
+#include "textbuffer.h"
+#include "lineindex.h"
+
+#include <QVector>
+#include <utility>
+
+namespace {
+// Pieces are kept short so splitting one (which recounts its newlines)
+// stays cheap no matter how large the document is.
+constexpr qsizetype kMaxPiece = 16 * 1024;
+constexpr qsizetype kAddChunkSize = 64 * 1024;
+
+int countNewlines(const QChar* data, qsizetype length)
+{
+    return int(LineIndex::countNewlines(reinterpret_cast<const char16_t*>(data), length));
+}
+
+quint32 nextRandom()
+{
+    // xorshift32; only the GUI thread edits buffers, but stay thread-safe.
+    thread_local quint32 state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+}
+
+// Text storage referenced by pieces. Only the tail past every piece is
+// ever written, so readers of older snapshots are never disturbed.
+struct TextChunk {
+    QString storage;
+};
+
+struct TextPiece {
+    std::shared_ptr<const TextPiece> left;
+    std::shared_ptr<const TextPiece> right;
+    std::shared_ptr<const TextChunk> chunk;
+    qsizetype start = 0;
+    qsizetype length = 0;
+    int newlines = 0;
+
+    // Subtree totals
+    qint64 totalLength = 0;
+    qint64 totalNewlines = 0;
+    int count = 1;
+
+    const QChar* data() const { return chunk->storage.constData() + start; }
+};
+
+using NodePtr = std::shared_ptr<const TextPiece>;
+
+namespace {
+
+qint64 lengthOf(const NodePtr& n) { return n ? n->totalLength : 0; }
+qint64 newlinesOf(const NodePtr& n) { return n ? n->totalNewlines : 0; }
+int countOf(const NodePtr& n) { return n ? n->count : 0; }
+
+NodePtr withChildren(const TextPiece& piece, NodePtr left, NodePtr right)
+{
+    auto node = std::make_shared<TextPiece>();
+    node->chunk = piece.chunk;
+    node->start = piece.start;
+    node->length = piece.length;
+    node->newlines = piece.newlines;
+    node->totalLength = lengthOf(left) + piece.length + lengthOf(right);
+    node->totalNewlines = newlinesOf(left) + piece.newlines + newlinesOf(right);
+    node->count = countOf(left) + 1 + countOf(right);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+
+NodePtr leaf(std::shared_ptr<const TextChunk> chunk, qsizetype start, qsizetype length)
+{
+    TextPiece piece;
+    piece.chunk = std::move(chunk);
+    piece.start = start;
+    piece.length = length;
+    piece.newlines = countNewlines(piece.data(), length);
+    return withChildren(piece, nullptr, nullptr);
+}
+
+// Randomized merge by subtree size keeps the tree balanced in expectation
+// without storing priorities.
+NodePtr merge(const NodePtr& a, const NodePtr& b)
+{
+    if (!a) return b;
+    if (!b) return a;
+
+    if (nextRandom() % quint32(a->count + b->count) < quint32(a->count))
+        return withChildren(*a, a->left, merge(a->right, b));
+    return withChildren(*b, merge(a, b->left), b->right);
+}
+
+// Splits into [0, position) and [position, end).
+std::pair<NodePtr, NodePtr> split(const NodePtr& t, qint64 position)
+{
+    if (!t)
+        return {};
+
+    const qint64 leftLength = lengthOf(t->left);
+    if (position <= leftLength) {
+        auto [a, b] = split(t->left, position);
+        return { a, withChildren(*t, b, t->right) };
+    }
+
+    position -= leftLength;
+    if (position >= t->length) {
+        auto [a, b] = split(t->right, position - t->length);
+        return { withChildren(*t, t->left, a), b };
+    }
+
+    // Inside this piece: cut it in two.
+    NodePtr head = leaf(t->chunk, t->start, position);
+    NodePtr tail = leaf(t->chunk, t->start + position, t->length - position);
+    return { merge(t->left, head), merge(tail, t->right) };
+}
+
+NodePtr buildBalanced(const QVector<NodePtr>& leaves, int lo, int hi)
+{
+    if (lo >= hi)
+        return nullptr;
+    const int mid = (lo + hi) / 2;
+    return withChildren(*leaves[mid], buildBalanced(leaves, lo, mid),
+                        buildBalanced(leaves, mid + 1, hi));
+}
+
+// Leaves for text stored as its own chunk, at most kMaxPiece each.
+QVector<NodePtr> leavesFor(const std::shared_ptr<const TextChunk>& chunk, qsizetype start, qsizetype length)
+{
+    QVector<NodePtr> leaves;
+    leaves.reserve(int(length / kMaxPiece) + 1);
+    for (qsizetype pos = 0; pos < length; pos += kMaxPiece)
+        leaves.append(leaf(chunk, start + pos, qMin(kMaxPiece, length - pos)));
+    return leaves;
+}
+
+void visitSpans(const NodePtr& t, qint64 from, qint64 to, qint64 base,
+                const std::function<void(QStringView)>& fn)
+{
+    if (!t || to <= base || from >= base + t->totalLength)
+        return;
+
+    visitSpans(t->left, from, to, base, fn);
+
+    const qint64 pieceBase = base + lengthOf(t->left);
+    const qint64 s = qMax(from, pieceBase);
+    const qint64 e = qMin(to, pieceBase + t->length);
+    if (s < e)
+        fn(QStringView(t->data() + (s - pieceBase), e - s));
+
+    visitSpans(t->right, from, to, pieceBase + t->length, fn);
+}
+
+} // namespace
+
+// --- TextSnapshot ---
+
+qint64 TextSnapshot::length() const
+{
+    return lengthOf(root_);
+}
+
+int TextSnapshot::lineCount() const
+{
+    return int(newlinesOf(root_)) + 1;
+}
+
+qint64 TextSnapshot::lineStart(int line) const
+{
+    if (line <= 0)
+        return 0;
+    if (line >= lineCount())
+        return length();
+
+    // Find the line-th newline; the line starts right after it.
+    qint64 base = 0;
+    qint64 remaining = line;
+    const TextPiece* t = root_.get();
+
+    while (t) {
+        const qint64 leftNewlines = newlinesOf(t->left);
+        if (remaining <= leftNewlines) {
+            t = t->left.get();
+            continue;
+        }
+
+        remaining -= leftNewlines;
+        base += lengthOf(t->left);
+
+        if (remaining <= t->newlines) {
+            const QChar* data = t->data();
+            for (qsizetype i = 0; i < t->length; ++i) {
+                if (data[i].unicode() == u'\n' && --remaining == 0)
+                    return base + i + 1;
+            }
+        }
+
+        remaining -= t->newlines;
+        base += t->length;
+        t = t->right.get();
+    }
+    return length();
+}
+
+int TextSnapshot::lineAt(qint64 position) const
+{
+    position = qBound<qint64>(0, position, length());
+
+    qint64 line = 0;
+    const TextPiece* t = root_.get();
+
+    while (t) {
+        const qint64 leftLength = lengthOf(t->left);
+        if (position < leftLength) {
+            t = t->left.get();
+            continue;
+        }
+
+        line += newlinesOf(t->left);
+        position -= leftLength;
+
+        if (position < t->length) {
+            line += countNewlines(t->data(), position);
+            break;
+        }
+
+        line += t->newlines;
+        position -= t->length;
+        t = t->right.get();
+    }
+    return int(line);
+}
+
+QString TextSnapshot::text(qint64 position, qint64 length) const
+{
+    QString out;
+    out.reserve(qMax<qint64>(0, length));
+    forEachSpan(position, length, [&out](QStringView span) { out.append(span); });
+    return out;
+}
+
+QString TextSnapshot::line(int line) const
+{
+    const qint64 start = lineStart(line);
+    const qint64 end = line + 1 < lineCount() ? lineStart(line + 1) - 1 : length();
+    return text(start, end - start);
+}
+
+void TextSnapshot::forEachSpan(qint64 position, qint64 length,
+                               const std::function<void(QStringView)>& fn) const
+{
+    if (length > 0)
+        visitSpans(root_, position, position + length, 0, fn);
+}
+
+void TextSnapshot::forEachLine(int first, const std::function<bool(int, QStringView)>& fn) const
+{
+    if (first < 0 || first >= lineCount())
+        return;
+    int line = first;
+    bool stop = false;
+    QString partial;   // only used when a line spans several pieces
+
+    const qint64 start = lineStart(first);
+    forEachSpan(start, length() - start, [&](QStringView span) {
+        while (!stop && !span.isEmpty()) {
+            const qsizetype nl = span.indexOf(u'\n');
+            if (nl < 0) {
+                partial.append(span);
+                return;
+            }
+
+            if (partial.isEmpty()) {
+                stop = !fn(line, span.first(nl));
+            } else {
+                partial.append(span.first(nl));
+                stop = !fn(line, partial);
+                partial.clear();
+            }
+            ++line;
+            span = span.sliced(nl + 1);
+        }
+    });
+
+    if (!stop)
+        fn(line, partial);
+}
+
+// --- TextBuffer ---
+
+void TextBuffer::setText(const QString& text)
+{
+    auto chunk = std::make_shared<TextChunk>();
+    chunk->storage = text;
+    const QVector<NodePtr> leaves = leavesFor(chunk, 0, text.size());
+    root_ = buildBalanced(leaves, 0, int(leaves.size()));
+    add_.reset();
+}
+
+void TextBuffer::insert(qint64 position, QStringView text)
+{
+    if (text.isEmpty())
+        return;
+
+    position = qBound<qint64>(0, position, length());
+
+    NodePtr inserted;
+    if (text.size() >= kAddChunkSize / 2) {
+        // Large inserts (pastes, loaded chunks) get a chunk of their own.
+        auto chunk = std::make_shared<TextChunk>();
+        chunk->storage = text.toString();
+        const QVector<NodePtr> leaves = leavesFor(chunk, 0, text.size());
+        inserted = buildBalanced(leaves, 0, int(leaves.size()));
+    } else {
+        if (!add_ || addUsed_ + text.size() > add_->storage.size()) {
+            add_ = std::make_shared<TextChunk>();
+            add_->storage = QString(kAddChunkSize, Qt::Uninitialized);
+            addWrite_ = add_->storage.data();   // detaches once, never again
+            addUsed_ = 0;
+        }
+        std::copy(text.begin(), text.end(), addWrite_ + addUsed_);
+        inserted = leaf(add_, addUsed_, text.size());
+        addUsed_ += text.size();
+    }
+
+    auto [a, b] = split(root_, position);
+    root_ = merge(merge(a, inserted), b);
+}
+
+void TextBuffer::remove(qint64 position, qint64 length)
+{
+    position = qBound<qint64>(0, position, this->length());
+    length = qBound<qint64>(0, length, this->length() - position);
+    if (length == 0)
+        return;
+
+    auto [a, rest] = split(root_, position);
+    auto [removed, b] = split(rest, length);
+    Q_UNUSED(removed);
+    root_ = merge(a, b);
+}
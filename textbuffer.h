@@ -0,0 +1,69 @@
+#pragma once
+#include <QString>
+#include <QStringView>
+#include <functional>
+#include <memory>
+
+struct TextPiece;
+struct TextChunk;
+
+// Immutable view of a TextBuffer at one point in time. Copying is O(1) and
+// snapshots can be read from any thread without locking: edits to the
+// buffer build new tree nodes and never touch the ones a snapshot holds.
+class TextSnapshot {
+public:
+    TextSnapshot() = default;
+
+    qint64 length() const;
+    int lineCount() const;
+
+    // Offset of the first character of a 0-based line, O(log n).
+    qint64 lineStart(int line) const;
+    // 0-based line containing position, O(log n).
+    int lineAt(qint64 position) const;
+
+    QString text(qint64 position, qint64 length) const;
+    QString line(int line) const;
+    QString toString() const { return text(0, length()); }
+
+    // True when both are the same version of the text. Any edit to the
+    // buffer gives later snapshots a new identity.
+    bool operator==(const TextSnapshot& other) const { return root_ == other.root_; }
+
+    // Calls fn for each stored span covering [position, position + length).
+    void forEachSpan(qint64 position, qint64 length,
+                     const std::function<void(QStringView)>& fn) const;
+    // Calls fn(line, text) for each line in order from line first; return
+    // false to stop.
+    void forEachLine(const std::function<bool(int, QStringView)>& fn) const { forEachLine(0, fn); }
+    void forEachLine(int first, const std::function<bool(int, QStringView)>& fn) const;
+
+private:
+    friend class TextBuffer;
+    explicit TextSnapshot(std::shared_ptr<const TextPiece> root) : root_(std::move(root)) {}
+
+    std::shared_ptr<const TextPiece> root_;
+};
+
+// Piece table kept in a persistent randomized binary tree. Pieces point
+// into immutable chunks (loaded text, or append-only add buffers), and
+// every node caches the length and newline count of its subtree, so
+// insert, remove and line lookups are O(log n).
+class TextBuffer {
+public:
+    TextBuffer() = default;
+
+    void setText(const QString& text);
+    void insert(qint64 position, QStringView text);
+    void remove(qint64 position, qint64 length);
+
+    TextSnapshot snapshot() const { return TextSnapshot(root_); }
+    qint64 length() const { return snapshot().length(); }
+    int lineCount() const { return snapshot().lineCount(); }
+
+private:
+    std::shared_ptr<const TextPiece> root_;
+    std::shared_ptr<TextChunk> add_;   // current add buffer, written at its tail only
+    QChar* addWrite_ = nullptr;
+    qsizetype addUsed_ = 0;
+};
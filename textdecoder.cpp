@@ -0,0 +1,363 @@
+#include "textdecoder.h"
+#include "simd.h"
+
+#include <cstring>
+
+namespace {
+
+// Enough to tell UTF-8 from Latin-1 without reading the whole file.
+constexpr qsizetype kDetectBytes = 64 * 1024;
+
+// File signatures that mean "not text" even when no NUL shows up early.
+struct Magic {
+    const char* bytes;
+    int length;
+};
+
+constexpr Magic kBinaryMagic[] = {
+    { "\x7f" "ELF", 4 },
+    { "\x89PNG\r\n\x1a\n", 8 },
+    { "\xff\xd8\xff", 3 },                 // JPEG
+    { "GIF87a", 6 }, { "GIF89a", 6 },
+    { "%PDF-", 5 },
+    { "PK\x03\x04", 4 },                    // zip, jar, docx, ...
+    { "7z\xbc\xaf\x27\x1c", 6 },
+    { "Rar!\x1a\x07", 6 },
+    { "\xfd" "7zXZ", 6 },
+    { "\x28\xb5\x2f\xfd", 4 },              // zstd
+    { "\xca\xfe\xba\xbe", 4 },              // Java class, fat Mach-O
+    { "\xcf\xfa\xed\xfe", 4 }, { "\xce\xfa\xed\xfe", 4 },
+    { "\0asm", 4 },
+    { "SQLite format 3", 16 },                // includes the NUL
+    { "OggS", 4 },
+};
+
+// An ASCII kernel widens the leading ASCII run of src into dst (same index)
+// and returns its length. It may write up to one vector past that length,
+// which the caller always has room for because dst holds one unit per byte.
+using AsciiKernel = qsizetype (*)(const uchar* src, qsizetype len, char16_t* dst);
+
+qsizetype asciiScalar(const uchar* src, qsizetype len, char16_t* dst)
+{
+    qsizetype i = 0;
+    while (i < len && src[i] < 0x80) {
+        dst[i] = src[i];
+        ++i;
+    }
+    return i;
+}
+
+#ifdef FILEEXPLORER_SSE2
+qsizetype asciiSse2(const uchar* src, qsizetype len, char16_t* dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    qsizetype i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+
+        const unsigned mask = unsigned(_mm_movemask_epi8(v));
+        if (mask)
+            return i + countTrailingZeros(mask);
+    }
+    return i + asciiScalar(src + i, len - i, dst + i);
+}
+
+FILEEXPLORER_TARGET_AVX2
+qsizetype asciiAvx2(const uchar* src, qsizetype len, char16_t* dst)
+{
+    qsizetype i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+        const __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16), hi);
+
+        const unsigned mask = unsigned(_mm256_movemask_epi8(v));
+        if (mask)
+            return i + countTrailingZeros(mask);
+    }
+    return i + asciiSse2(src + i, len - i, dst + i);
+}
+
+#endif // FILEEXPLORER_SSE2
+
+struct KernelChoice {
+    AsciiKernel kernel;
+    const char* name;
+};
+
+const KernelChoice& kernelChoice()
+{
+    static const KernelChoice choice = []() -> KernelChoice {
+#ifdef FILEEXPLORER_SSE2
+        if (cpuHasAvx2())
+            return { asciiAvx2, "avx2" };
+        return { asciiSse2, "sse2" };
+#else
+        return { asciiScalar, "scalar" };
+#endif
+    }();
+    return choice;
+}
+
+// Decodes UTF-8 into UTF-16. dst must have room for len units.
+// Stops before an incomplete sequence at the end (*consumed tells where).
+// Invalid input returns -1 when strict, else becomes U+FFFD and sets
+// *replaced.
+qsizetype decodeUtf8(const uchar* src, qsizetype len, char16_t* dst,
+                     bool strict, qsizetype* consumed, bool* replaced = nullptr)
+{
+    const AsciiKernel ascii = kernelChoice().kernel;
+    qsizetype i = 0;
+    qsizetype o = 0;
+
+    while (i < len) {
+        const uchar b = src[i];
+
+        if (b < 0x80) {
+            const qsizetype n = ascii(src + i, len - i, dst + o);
+            i += n;
+            o += n;
+            continue;
+        }
+
+        int need;
+        char32_t cp;
+        char32_t min;
+        if ((b & 0xE0) == 0xC0)      { need = 1; cp = b & 0x1F; min = 0x80; }
+        else if ((b & 0xF0) == 0xE0) { need = 2; cp = b & 0x0F; min = 0x800; }
+        else if ((b & 0xF8) == 0xF0) { need = 3; cp = b & 0x07; min = 0x10000; }
+        else                         { need = -1; cp = 0; min = 0; }
+
+        bool valid = need > 0;
+        if (valid && i + need >= len) {
+            // Not enough bytes left: wait for more if what we have fits.
+            bool prefixOk = true;
+            for (qsizetype k = i + 1; k < len; ++k)
+                prefixOk = prefixOk && (src[k] & 0xC0) == 0x80;
+            if (prefixOk)
+                break;
+            valid = false;
+        }
+
+        if (valid) {
+            for (int k = 1; k <= need; ++k) {
+                const uchar c = src[i + k];
+                if ((c & 0xC0) != 0x80) {
+                    valid = false;
+                    break;
+                }
+                cp = (cp << 6) | (c & 0x3F);
+            }
+            valid = valid && cp >= min && cp <= 0x10FFFF && (cp < 0xD800 || cp > 0xDFFF);
+        }
+
+        if (!valid) {
+            if (strict) {
+                *consumed = i;
+                return -1;
+            }
+            dst[o++] = 0xFFFD;
+            if (replaced)
+                *replaced = true;
+            ++i;
+            continue;
+        }
+
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            dst[o++] = char16_t(0xD800 + (cp >> 10));
+            dst[o++] = char16_t(0xDC00 + (cp & 0x3FF));
+        } else {
+            dst[o++] = char16_t(cp);
+        }
+        i += need + 1;
+    }
+
+    *consumed = i;
+    return o;
+}
+
+} // namespace
+
+TextDecoder::TextDecoder()
+    : detectPending_(true)
+{}
+
+TextDecoder::TextDecoder(Encoding encoding)
+{
+    setEncoding(encoding);
+}
+
+void TextDecoder::setEncoding(Encoding encoding)
+{
+    encoding_ = encoding;
+
+    if (encoding == Utf16LE)
+        utf16_ = QStringDecoder(QStringDecoder::Utf16LE);
+    else if (encoding == Utf16BE)
+        utf16_ = QStringDecoder(QStringDecoder::Utf16BE);
+}
+
+const char* TextDecoder::simdLevel()
+{
+    return kernelChoice().name;
+}
+
+TextDecoder::Encoding TextDecoder::detect(const char* data, qsizetype size, int* bomLength)
+{
+    const uchar* u = reinterpret_cast<const uchar*>(data);
+    int bom = 0;
+    Encoding encoding = Utf8;
+
+    if (size >= 3 && u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF) {
+        bom = 3;
+    } else if (size >= 2 && u[0] == 0xFF && u[1] == 0xFE) {
+        bom = 2;
+        encoding = Utf16LE;
+    } else if (size >= 2 && u[0] == 0xFE && u[1] == 0xFF) {
+        bom = 2;
+        encoding = Utf16BE;
+    } else {
+        // BOM-less UTF-16: mostly-ASCII text has a NUL in every other byte.
+        const qsizetype n = qMin<qsizetype>(size, 4096) & ~qsizetype(1);
+        qsizetype evenZeros = 0;
+        qsizetype oddZeros = 0;
+        for (qsizetype i = 0; i < n; i += 2) {
+            evenZeros += u[i] == 0;
+            oddZeros += u[i + 1] == 0;
+        }
+
+        const qsizetype pairs = n / 2;
+        if (pairs >= 2 && oddZeros * 10 > pairs * 4 && evenZeros * 20 < pairs)
+            encoding = Utf16LE;
+        else if (pairs >= 2 && evenZeros * 10 > pairs * 4 && oddZeros * 20 < pairs)
+            encoding = Utf16BE;
+        else if (!isValidUtf8(data, qMin(size, kDetectBytes)))
+            encoding = Latin1;
+    }
+
+    if (bomLength)
+        *bomLength = bom;
+    return encoding;
+}
+
+bool TextDecoder::looksBinary(const char* data, qsizetype size)
+{
+    for (const Magic& m : kBinaryMagic) {
+        if (size >= m.length && std::memcmp(data, m.bytes, size_t(m.length)) == 0)
+            return true;
+    }
+
+    // UTF-16 text is full of NULs.
+    const Encoding encoding = detect(data, size);
+    if (encoding == Utf16LE || encoding == Utf16BE)
+        return false;
+
+    // Text has no NULs and few control characters; tabs, line ends, form
+    // feeds and the escapes of coloured logs are fine.
+    const uchar* u = reinterpret_cast<const uchar*>(data);
+    const qsizetype n = qMin(size, kSniffBytes);
+    qsizetype control = 0;
+    for (qsizetype i = 0; i < n; ++i) {
+        if (u[i] == 0)
+            return true;
+        if (u[i] < 0x20 && u[i] != '\t' && u[i] != '\n' && u[i] != '\r'
+            && u[i] != '\f' && u[i] != '\v' && u[i] != 0x1b)
+            ++control;
+    }
+    return control * 10 > n;
+}
+
+bool TextDecoder::isValidUtf8(const char* data, qsizetype size)
+{
+    char16_t scratch[4096];
+    const uchar* src = reinterpret_cast<const uchar*>(data);
+
+    while (size > 0) {
+        const qsizetype n = qMin<qsizetype>(size, 4096);
+        qsizetype consumed = 0;
+        if (decodeUtf8(src, n, scratch, true, &consumed) < 0)
+            return false;
+        if (consumed == 0)
+            return n == size; // incomplete sequence at the very end
+        src += consumed;
+        size -= consumed;
+    }
+    return true;
+}
+
+QString TextDecoder::decode(const QByteArray& bytes)
+{
+    int bom = 0;
+    const Encoding encoding = detect(bytes.constData(), bytes.size(), &bom);
+    const char* data = bytes.constData() + bom;
+    const qsizetype size = bytes.size() - bom;
+
+    switch (encoding) {
+    case Utf16LE:
+        return QStringDecoder(QStringDecoder::Utf16LE).decode(QByteArrayView(data, size));
+    case Utf16BE:
+        return QStringDecoder(QStringDecoder::Utf16BE).decode(QByteArrayView(data, size));
+    case Latin1:
+        return QString::fromLatin1(data, size);
+    case Utf8:
+        break;
+    }
+
+    QString out(size, Qt::Uninitialized);
+    qsizetype consumed = 0;
+    const qsizetype n = decodeUtf8(reinterpret_cast<const uchar*>(data), size,
+                                   reinterpret_cast<char16_t*>(out.data()), true, &consumed);
+    if (n < 0)
+        return QString::fromLatin1(data, size);
+
+    out.truncate(n);
+    return out;
+}
+
+QString TextDecoder::feed(const char* data, qsizetype size)
+{
+    QByteArray joined;
+    if (!pending_.isEmpty()) {
+        joined = pending_ + QByteArray::fromRawData(data, size);
+        pending_.clear();
+        data = joined.constData();
+        size = joined.size();
+    }
+
+    if (detectPending_) {
+        detectPending_ = false;
+        int bom = 0;
+        setEncoding(detect(data, size, &bom));
+        bom_ = bom > 0;
+        data += bom;
+        size -= bom;
+    }
+
+    switch (encoding_) {
+    case Utf16LE:
+    case Utf16BE:
+        return utf16_.decode(QByteArrayView(data, size));
+    case Latin1:
+        return QString::fromLatin1(data, size);
+    case Utf8:
+        break;
+    }
+
+    QString out(size, Qt::Uninitialized);
+    qsizetype consumed = 0;
+    const qsizetype n = decodeUtf8(reinterpret_cast<const uchar*>(data), size,
+                                   reinterpret_cast<char16_t*>(out.data()), false, &consumed,
+                                   &replaced_);
+    out.truncate(n);
+
+    if (consumed < size)
+        pending_ = QByteArray(data + consumed, size - consumed);
+    return out;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <QStringDecoder>
+
+// Encoding detection + decoding for files opened in the viewer.
+// UTF-8 (which includes pure ASCII) goes through a validate-and-widen loop
+// whose ASCII runs are widened with AVX2 / SSE2 (scalar fallback); multi-
+// byte sequences are decoded one at a time. UTF-16 and Latin-1 are only
+// used when a BOM or the content asks for them.
+class TextDecoder {
+public:
+    enum Encoding { Utf8, Utf16LE, Utf16BE, Latin1 };
+
+    // Detects the encoding from the first chunk fed in.
+    TextDecoder();
+    explicit TextDecoder(Encoding encoding);
+
+    // Looks at the first bytes of a file. bomLength receives the number of
+    // BOM bytes to skip.
+    static Encoding detect(const char* data, qsizetype size, int* bomLength = nullptr);
+
+    // Content sniffing for files that should not be shown as text: known
+    // binary signatures, NULs outside UTF-16, or many control bytes. Only
+    // the first kSniffBytes are looked at.
+    static constexpr qsizetype kSniffBytes = 8 * 1024;
+    static bool looksBinary(const char* data, qsizetype size);
+
+    // One-shot: detect, skip the BOM and decode. A truncated multi-byte
+    // sequence at the very end is dropped (useful for partial reads).
+    static QString decode(const QByteArray& bytes);
+
+    // Streaming: bytes of a sequence split across calls are carried over.
+    // The encoding is detected from the first 64 KB; invalid UTF-8 after
+    // that becomes U+FFFD and sets hadInvalidBytes().
+    QString feed(const char* data, qsizetype size);
+    QString feed(const QByteArray& bytes) { return feed(bytes.constData(), bytes.size()); }
+
+    Encoding encoding() const { return encoding_; }
+    // The first chunk started with a byte order mark.
+    bool hadBom() const { return bom_; }
+    // Some UTF-8 input was invalid and replaced; the original bytes cannot
+    // be written back.
+    bool hadInvalidBytes() const { return replaced_; }
+
+    // Strict UTF-8 check; an incomplete sequence at the end counts as valid.
+    static bool isValidUtf8(const char* data, qsizetype size);
+
+    // Vector path picked at runtime: "avx2", "sse2" or "scalar".
+    static const char* simdLevel();
+
+private:
+    void setEncoding(Encoding encoding);
+
+    Encoding encoding_ = Utf8;
+    bool bom_ = false;
+    bool replaced_ = false;
+    bool detectPending_ = false;
+    QByteArray pending_;
+    QStringDecoder utf16_;
+};
+
+// How a text file was stored, so saving writes it back the same way. The
+// document itself always has LF line endings.
+struct TextFormat {
+    TextDecoder::Encoding encoding = TextDecoder::Utf8;
+    bool bom = false;
+    // Invalid bytes were replaced on load; saving over the file would
+    // destroy them.
+    bool lossy = false;
+#ifdef Q_OS_WIN
+    bool crlf = true;    // new files get the platform's line ending
+#else
+    bool crlf = false;
+#endif
+};